@@ -0,0 +1,305 @@
+/**
+    @file AdmissionControl.cpp
+    @brief This file contains the definition for all the member functions of the AdmissionControl class
+
+*/
+
+#include <AdmissionControl.h>
+#include <SessionConfig.h>
+#include <SessionStats.h>
+#include <TrafficCapture.h>
+#include <QueueShards.h>
+#include <RequestHeader.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/msg.h>
+
+using namespace SPS;
+
+pthread_mutex_t 						AdmissionControl::_mutex = PTHREAD_MUTEX_INITIALIZER;
+bool 									AdmissionControl::_isLimitsLoaded = false;
+AdmissionLimits 						AdmissionControl::_userLimits;
+AdmissionLimits 						AdmissionControl::_serverLimits;
+int 									AdmissionControl::_pushTimeout;
+int 									AdmissionControl::_latencyDecay;
+volatile int 							AdmissionControl::_stalledCount = 0;
+std::map<int, bool> 					AdmissionControl::_stalledQueues;
+std::map<const OSSUserInfo*, AdmissionState> 	AdmissionControl::_userState;
+std::map<unsigned long long, AdmissionState> 	AdmissionControl::_serverState;
+
+#define LATENCY_AVERAGE_WEIGHT 	8	//!< Weight of the moving average, each new sample contributes 1/8th to the average latency
+#define PUSH_RETRY_FIRST 		1	//!< Interval in milliseconds before the first retry of a push to a full Response Message Queue
+#define PUSH_RETRY_MAX 			64	//!< Maximum interval in milliseconds between the retries, the interval doubles up to it
+
+
+
+/**
+ * @fn loadLimits
+ * @param Nil
+ * @ret void
+ * @brief Reads the limits from the configuration on first use. Should be invoked with the mutex held
+ */
+void AdmissionControl::loadLimits()
+{
+	if (_isLimitsLoaded)
+	{
+		return;
+	}
+
+	_userLimits.maxQueueDepth = SessionConfig::GetInt("UserMaxQueueDepth", 0);
+	_userLimits.maxInFlight = SessionConfig::GetInt("UserMaxInFlight", 0);
+	_userLimits.maxLatency = SessionConfig::GetInt("UserMaxLatencyMs", 0);
+	_serverLimits.maxQueueDepth = 0;
+	_serverLimits.maxInFlight = SessionConfig::GetInt("ServerMaxInFlight", 0);
+	_serverLimits.maxLatency = SessionConfig::GetInt("ServerMaxLatencyMs", 0);
+	_pushTimeout = SessionConfig::GetInt("ResponsePushTimeoutMs", 1000);
+	_latencyDecay = SessionConfig::GetInt("LatencyDecayMs", 1000);
+	_isLimitsLoaded = true;
+}//void AdmissionControl::loadLimits()
+
+
+
+/**
+ * @fn checkLimits
+ * @param Load observed
+ * @param Limits to be applied
+ * @param Depth of the Request Message Queue
+ * @ret returns NULL if all the limits are met, else the name of the limit which tripped
+ * @brief The latency limit is applied only when some request is in flight, so that a single request always goes through to measure
+		the latency again once SPS recovers.
+ */
+const char* AdmissionControl::checkLimits(const AdmissionState &pState, const AdmissionLimits &pLimits, int pQueueDepth)
+{
+	if (0 < pLimits.maxQueueDepth && pQueueDepth > pLimits.maxQueueDepth)
+	{
+		return "Queue Depth";
+	}
+	if (0 < pLimits.maxInFlight && pState.inFlight >= pLimits.maxInFlight)
+	{
+		return "In Flight";
+	}
+	if (0 < pLimits.maxLatency && 0 < pState.inFlight && pState.avgLatency > pLimits.maxLatency)
+	{
+		return "Latency";
+	}
+	return NULL;
+}//const char* AdmissionControl::checkLimits(...)
+
+
+
+/**
+ * @fn decayLatency
+ * @param Load observed
+ * @param Current time in epoch milliseconds
+ * @ret void
+ * @brief Halves the average latency for every LatencyDecayMs passed since the last completed request. Should be invoked with the
+		mutex held
+ */
+void AdmissionControl::decayLatency(AdmissionState &pState, long long pNow)
+{
+	long long 	lPeriods;	//!< Number of LatencyDecayMs periods passed
+
+	if (0 >= _latencyDecay || 0 == pState.avgLatency || pNow - pState.lastUpdate < _latencyDecay)
+	{
+		return;
+	}
+	lPeriods = (pNow - pState.lastUpdate) / _latencyDecay;
+	pState.avgLatency = (lPeriods >= 63) ? 0 : pState.avgLatency >> lPeriods;
+	pState.lastUpdate += lPeriods * _latencyDecay;
+}//void AdmissionControl::decayLatency(AdmissionState &pState, long long pNow)
+
+
+
+/**
+ * @fn Admit
+ * @param Pointer to the user for which the request is received
+ * @param Address of the SPS server to which the request will be sent, as returned by getPeerName
+ * @ret returns NULL if the request is admitted, else the name of the limit which tripped
+ * @brief On admission, the request is counted as in flight till Complete is invoked
+ */
+const char* AdmissionControl::Admit(OSSUserInfo *pUser, unsigned long long pServer)
+{
+	int 				lQueueDepth = 0;	//!< Number of requests waiting in the Request Message Queues of the user
+	const char 			*lpReason;			//!< Name of the limit which tripped
+	long long 			lNow;				//!< Current time in epoch milliseconds
+
+	lNow = RequestHeader::NowMillis();
+
+	pthread_mutex_lock(&_mutex);
+	loadLimits();
+
+	AdmissionState &lUserState = _userState[pUser];
+	AdmissionState &lServerState = _serverState[pServer];
+	decayLatency(lUserState, lNow);
+	decayLatency(lServerState, lNow);
+
+	if (0 < _userLimits.maxQueueDepth)
+	{
+		lQueueDepth = QueueShards::GetQueueDepth(pUser);
+	}
+
+	lpReason = checkLimits(lUserState, _userLimits, lQueueDepth);
+	if (NULL == lpReason)
+	{
+		lpReason = checkLimits(lServerState, _serverLimits, 0);
+	}
+
+	if (NULL == lpReason)
+	{
+		lUserState.inFlight++;
+		lServerState.inFlight++;
+	}
+	pthread_mutex_unlock(&_mutex);
+
+	if (NULL != lpReason)
+	{
+		SessionStats::Increment(SHED_REQUESTS);
+	}
+	return lpReason;
+}//const char* AdmissionControl::Admit(OSSUserInfo *pUser, unsigned long long pServer)
+
+
+
+/**
+ * @fn Complete
+ * @param Pointer to the user for which the request was admitted
+ * @param Address of the SPS server to which the request was sent
+ * @param Time in milliseconds taken by SPS to respond
+ * @ret void
+ * @brief Removes the request from the in flight count and updates the average latency
+ */
+void AdmissionControl::Complete(OSSUserInfo *pUser, unsigned long long pServer, long long pLatency)
+{
+	long long 	lNow;		//!< Current time in epoch milliseconds
+
+	lNow = RequestHeader::NowMillis();
+
+	pthread_mutex_lock(&_mutex);
+
+	AdmissionState &lUserState = _userState[pUser];
+	AdmissionState &lServerState = _serverState[pServer];
+
+	lUserState.inFlight--;
+	lServerState.inFlight--;
+	lUserState.avgLatency += (pLatency - lUserState.avgLatency) / LATENCY_AVERAGE_WEIGHT;
+	lServerState.avgLatency += (pLatency - lServerState.avgLatency) / LATENCY_AVERAGE_WEIGHT;
+	lUserState.lastUpdate = lNow;
+	lServerState.lastUpdate = lNow;
+
+	pthread_mutex_unlock(&_mutex);
+}//void AdmissionControl::Complete(...)
+
+
+
+/**
+ * @fn PushResponse
+ * @param Pointer to the user to which the response belongs
+ * @param Response to be pushed to the Response Message Queue
+ * @ret returns 0 on success and -1 if the response is dropped
+ * @brief Pushes the response without blocking indefinitely on a full Response Message Queue. If the queue stays full for the configured
+		time, the response is dropped so that the XMLIAClient thread is not stalled by a Service Layer which is not reading the responses.
+ */
+int AdmissionControl::PushResponse(OSSUserInfo *pUser, MsqQueStruct &pMsg)
+{
+	pthread_mutex_lock(&_mutex);
+	loadLimits();
+	pthread_mutex_unlock(&_mutex);
+
+	return push(pUser, pMsg, _pushTimeout);
+}//int AdmissionControl::PushResponse(OSSUserInfo *pUser, MsqQueStruct &pMsg)
+
+
+
+/**
+ * @fn TryPushResponse
+ * @param Pointer to the user to which the response belongs
+ * @param Response to be pushed to the Response Message Queue
+ * @ret returns 0 on success and -1 if the response is dropped
+ * @brief Pushes the response only if the Response Message Queue has room. Used by the shut down drain, which answers the whole backlog
+		within the deadline
+ */
+int AdmissionControl::TryPushResponse(OSSUserInfo *pUser, MsqQueStruct &pMsg)
+{
+	return push(pUser, pMsg, 0);
+}
+
+
+
+/**
+ * @fn push
+ * @param Pointer to the user to which the response belongs
+ * @param Response to be pushed to the Response Message Queue
+ * @param Maximum time in milliseconds to wait on a full Response Message Queue
+ * @ret returns 0 on success and -1 if the response is dropped
+ * @brief The queue id comes from the ids QueueShards keeps for the user, so no msgget is made per response
+ */
+int AdmissionControl::push(OSSUserInfo *pUser, MsqQueStruct &pMsg, int pTimeout)
+{
+	int 	lQueueId;							//!< Id of the Response Message Queue of the shard of the mType
+	int 	lWaited = 0;						//!< Time in milliseconds spent waiting on the full queue
+	int 	lInterval = PUSH_RETRY_FIRST;		//!< Time in milliseconds before the next attempt
+	bool 	lIsStalled;							//!< Set if the last push to the queue timed out
+	int 	lErrno;								//!< Error of the last attempt
+
+	TrafficCapture::Record(CAPTURE_RESPONSE, pUser->userName, pMsg.mType, pMsg.xmlRequest);
+
+	lQueueId = QueueShards::GetResponseQueueId(pUser, pMsg.mType);
+	if (lQueueId < 0)
+	{
+		return -1;
+	}
+
+	if (0 == msgsnd(lQueueId, &pMsg, sizeof(pMsg.xmlRequest), IPC_NOWAIT))
+	{
+		if (0 != _stalledCount)
+		{
+			pthread_mutex_lock(&_mutex);
+			_stalledCount -= _stalledQueues.erase(lQueueId);
+			pthread_mutex_unlock(&_mutex);
+		}
+		return 0;
+	}
+
+	lErrno = errno;
+
+	//! The queue timed out on the previous push and is still full, the Service Layer is not reading it
+	pthread_mutex_lock(&_mutex);
+	lIsStalled = (_stalledQueues.end() != _stalledQueues.find(lQueueId));
+	pthread_mutex_unlock(&_mutex);
+	if (lIsStalled)
+	{
+		SessionStats::Increment(DROPPED_RESPONSES);
+		return -1;
+	}
+
+	do
+	{
+		if ((EAGAIN != lErrno && EINTR != lErrno) || lWaited >= pTimeout)
+		{
+			//! A push which was not allowed to wait does not mark the queue, it is only full for the moment
+			if (EAGAIN == lErrno && 0 < pTimeout)
+			{
+				pthread_mutex_lock(&_mutex);
+				if (_stalledQueues.insert(std::make_pair(lQueueId, true)).second)
+				{
+					_stalledCount++;
+				}
+				pthread_mutex_unlock(&_mutex);
+			}
+			SessionStats::Increment(DROPPED_RESPONSES);
+			return -1;
+		}
+
+		//! Backing off, so that a queue which frees up at once is retried soon and a queue which stays full is not polled every few ms
+		lInterval = (lInterval < pTimeout - lWaited) ? lInterval : pTimeout - lWaited;
+		usleep(lInterval * 1000);
+		lWaited += lInterval;
+		lInterval = (lInterval * 2 < PUSH_RETRY_MAX) ? lInterval * 2 : PUSH_RETRY_MAX;
+		lErrno = (0 == msgsnd(lQueueId, &pMsg, sizeof(pMsg.xmlRequest), IPC_NOWAIT)) ? 0 : errno;
+	} while (0 != lErrno);
+
+	pthread_mutex_lock(&_mutex);
+	_stalledCount -= _stalledQueues.erase(lQueueId);
+	pthread_mutex_unlock(&_mutex);
+	return 0;
+}//int AdmissionControl::push(OSSUserInfo *pUser, MsqQueStruct &pMsg, int pTimeout)
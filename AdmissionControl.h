@@ -0,0 +1,70 @@
+/**
+    @file AdmissionControl.h
+    @brief Declaration of the AdmissionControl class used to shed the load early when SPS slows down
+
+	A request is admitted only if the depth of the Request Message Queue of the user, the number of requests in flight and the average
+	SPS latency observed for the user and for the SPS server are within the limits configured in Conf/session.conf. A limit of 0 disables
+	the check. Requests which are not admitted are answered with the SessionLayerError response without being sent to SPS. The average
+	latency is halved for every LatencyDecayMs without a completed request, so that the latency limit does not stay tripped while all
+	the requests are shed.
+
+	A response is pushed without blocking. On a full Response Message Queue the push is retried with a growing interval for up to
+	ResponsePushTimeoutMs. Once a queue has timed out, the following responses to it are dropped at once till a push to it succeeds
+	again, so that a Service Layer which is not reading does not cost every response the whole timeout.
+*/
+
+#ifndef _ADMISSION_CONTROL_H_
+#define _ADMISSION_CONTROL_H_
+
+#include <OSSUserInfo.h>
+#include <map>
+#include <pthread.h>
+
+namespace SPS
+{
+	//! Limits applied on a user or on a SPS server
+	struct AdmissionLimits
+	{
+		int 	maxQueueDepth;		//!< Maximum number of requests waiting in the Request Message Queue
+		int 	maxInFlight;		//!< Maximum number of requests sent to SPS and waiting for the response
+		int 	maxLatency;			//!< Maximum average SPS latency in milliseconds
+	};
+
+	//! Load observed for a user or for a SPS server
+	struct AdmissionState
+	{
+		int 		inFlight;		//!< Number of requests sent to SPS and waiting for the response
+		long long 	avgLatency;		//!< Moving average of the SPS latency in milliseconds
+		long long 	lastUpdate;		//!< Time in epoch milliseconds up to which the average latency is decayed
+
+		AdmissionState() : inFlight(0), avgLatency(0), lastUpdate(0) {}
+	};
+
+	class AdmissionControl
+	{
+		public:
+			static const char* Admit(OSSUserInfo *pUser, unsigned long long pServer);
+			static void Complete(OSSUserInfo *pUser, unsigned long long pServer, long long pLatency);
+			static int PushResponse(OSSUserInfo *pUser, MsqQueStruct &pMsg);
+			static int TryPushResponse(OSSUserInfo *pUser, MsqQueStruct &pMsg);
+
+		private:
+			static void loadLimits();
+			static int push(OSSUserInfo *pUser, MsqQueStruct &pMsg, int pTimeout);
+			static const char* checkLimits(const AdmissionState &pState, const AdmissionLimits &pLimits, int pQueueDepth);
+			static void decayLatency(AdmissionState &pState, long long pNow);
+
+			static pthread_mutex_t 						_mutex;				//!< Protects the state maps
+			static bool 								_isLimitsLoaded;	//!< Set once the limits are read from the configuration
+			static AdmissionLimits 						_userLimits;		//!< Limits applied on each user
+			static AdmissionLimits 						_serverLimits;		//!< Limits applied on each SPS server
+			static int 									_pushTimeout;		//!< Maximum time in milliseconds to wait on a full Response Message Queue
+			static int 									_latencyDecay;		//!< Time in milliseconds without a completed request which halves the average latency
+			static volatile int 						_stalledCount;		//!< Number of Response Message Queues in _stalledQueues
+			static std::map<int, bool> 					_stalledQueues;		//!< Response Message Queues on which the last push timed out
+			static std::map<const OSSUserInfo*, AdmissionState> 	_userState;			//!< Load observed for each user
+			static std::map<unsigned long long, AdmissionState> 	_serverState;		//!< Load observed for each SPS server
+	};
+}
+
+#endif
@@ -0,0 +1,236 @@
+/**
+    @file ConfigSnapshot.cpp
+    @brief This file contains the definition for all the member functions of the ConfigSnapshot class
+
+*/
+
+#include <ConfigSnapshot.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace SPS;
+
+
+
+/**
+ * @fn checksum
+ * @param Pointer to the data
+ * @param Length of the data
+ * @ret returns the FNV-1a checksum of the data
+ */
+unsigned int ConfigSnapshot::checksum(const char *pData, size_t pLength)
+{
+	unsigned int 	lHash = 2166136261U;	//!< FNV offset basis
+	size_t 			lIndex;					//!< Used as index in loops
+
+	for (lIndex = 0; lIndex < pLength; lIndex++)
+	{
+		lHash = (lHash ^ (unsigned char) pData[lIndex]) * 16777619U;
+	}
+	return lHash;
+}
+
+
+
+/**
+ * @fn FillUser
+ * @param Record to be filled
+ * @param User loaded from the database
+ * @ret void
+ */
+void ConfigSnapshot::FillUser(SnapshotUser &pRecord, const OSSUserInfo *pUser)
+{
+	memset(&pRecord, '\0', sizeof(pRecord));
+	strncpy(pRecord.userName, pUser->userName, sizeof(pRecord.userName) - 1);
+	strncpy(pRecord.password, pUser->password, sizeof(pRecord.password) - 1);
+	pRecord.requestQueueKey = pUser->requestQueueKey;
+	pRecord.responseQueueKey = pUser->responseQueueKey;
+	pRecord.maxConnection = pUser->maxConnection;
+	strncpy(pRecord.touchFileName, pUser->touchFileName, sizeof(pRecord.touchFileName) - 1);
+}
+
+
+
+/**
+ * @fn Save
+ * @param Name of the snapshot file
+ * @param Records of the users loaded from the database, filled through FillUser
+ * @param SPS servers loaded from the database
+ * @ret returns 0 on success and -1 on failure
+ * @brief Writes the snapshot to <file>.<process id>.tmp and renames it to the snapshot file
+ */
+int ConfigSnapshot::Save(const char *pFileName, const std::vector<SnapshotUser> &pUsers, const SPSServerInfoVector &pServers)
+{
+	std::vector<char> 	lBuffer;			//!< Contents of the file
+	SnapshotHeader 		*lpHeader;			//!< Header in the buffer
+	SnapshotUser 		*lpUser;			//!< User record in the buffer
+	SnapshotServer 		*lpServer;			//!< Server record in the buffer
+	char 				lTempFile[1100];	//!< Temporary file written before the rename
+	int 				lIndex;				//!< Used as index in loops
+	int 				lFd;				//!< Descriptor of the temporary file
+	ssize_t 			lWritten;			//!< Number of bytes written
+
+	lBuffer.resize(sizeof(SnapshotHeader) + pUsers.size() * sizeof(SnapshotUser) + pServers.size() * sizeof(SnapshotServer), '\0');
+	lpHeader = (SnapshotHeader*) &lBuffer[0];
+	lpUser = (SnapshotUser*) (lpHeader + 1);
+	lpServer = (SnapshotServer*) (lpUser + pUsers.size());
+
+	for (lIndex = 0; lIndex < pUsers.size(); lIndex++, lpUser++)
+	{
+		*lpUser = pUsers[lIndex];
+	}
+
+	for (lIndex = 0; lIndex < pServers.size(); lIndex++, lpServer++)
+	{
+		strncpy(lpServer->ipAddress, pServers[lIndex]->ipAddress, sizeof(lpServer->ipAddress) - 1);
+		lpServer->portNum = pServers[lIndex]->portNum;
+		lpServer->retryAttempt = pServers[lIndex]->retryAttempt;
+		lpServer->retryInterval = pServers[lIndex]->retryInterval;
+		strncpy(lpServer->spsHomePath, pServers[lIndex]->spsHomePath, sizeof(lpServer->spsHomePath) - 1);
+	}
+
+	lpHeader->magic = SNAPSHOT_MAGIC;
+	lpHeader->version = SNAPSHOT_VERSION;
+	lpHeader->userCount = pUsers.size();
+	lpHeader->serverCount = pServers.size();
+	lpHeader->createdTime = time(NULL);
+	lpHeader->checksum = checksum(&lBuffer[sizeof(SnapshotHeader)], lBuffer.size() - sizeof(SnapshotHeader));
+
+	snprintf(lTempFile, sizeof(lTempFile), "%s.%d.tmp", pFileName, (int) getpid());
+	lFd = open(lTempFile, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (lFd < 0)
+	{
+		return -1;
+	}
+	lWritten = write(lFd, &lBuffer[0], lBuffer.size());
+	if (lWritten != (ssize_t) lBuffer.size() || 0 != fsync(lFd))
+	{
+		close(lFd);
+		remove(lTempFile);
+		return -1;
+	}
+	close(lFd);
+
+	return rename(lTempFile, pFileName);
+}//int ConfigSnapshot::Save(...)
+
+
+
+/**
+ * @fn ConfigSnapshot
+ * @param Nil
+ * @brief Constructor of the ConfigSnapshot used to intialize the member variables
+ */
+ConfigSnapshot::ConfigSnapshot()
+{
+	_mapAddress = NULL;
+	_mapLength = 0;
+	_header = NULL;
+}
+
+
+
+/**
+ * @fn ~ConfigSnapshot
+ * @param Nil
+ * @brief Destructor of the ConfigSnapshot. Unmaps the snapshot
+ */
+ConfigSnapshot::~ConfigSnapshot()
+{
+	Close();
+}
+
+
+
+/**
+ * @fn Open
+ * @param Name of the snapshot file
+ * @ret returns 0 on success and -1 if the file is missing, of a different version or corrupted
+ * @brief Maps the snapshot into memory and validates it
+ */
+int ConfigSnapshot::Open(const char *pFileName)
+{
+	struct stat 	lFileInfo;		//!< Status of the snapshot file
+	int 			lFd;			//!< Descriptor of the snapshot file
+
+	Close();
+
+	lFd = open(pFileName, O_RDONLY);
+	if (lFd < 0)
+	{
+		return -1;
+	}
+	if (0 != fstat(lFd, &lFileInfo) || lFileInfo.st_size < (off_t) sizeof(SnapshotHeader))
+	{
+		close(lFd);
+		return -1;
+	}
+
+	_mapLength = lFileInfo.st_size;
+	_mapAddress = mmap(NULL, _mapLength, PROT_READ, MAP_PRIVATE, lFd, 0);
+	close(lFd);
+	if (MAP_FAILED == _mapAddress)
+	{
+		_mapAddress = NULL;
+		return -1;
+	}
+
+	_header = (SnapshotHeader*) _mapAddress;
+	if (SNAPSHOT_MAGIC != _header->magic || SNAPSHOT_VERSION != _header->version
+		|| _mapLength != sizeof(SnapshotHeader) + _header->userCount * sizeof(SnapshotUser) + _header->serverCount * sizeof(SnapshotServer)
+		|| _header->checksum != checksum((const char*) (_header + 1), _mapLength - sizeof(SnapshotHeader)))
+	{
+		Close();
+		return -1;
+	}
+	return 0;
+}//int ConfigSnapshot::Open(const char *pFileName)
+
+
+
+/**
+ * @fn Close
+ * @param Nil
+ * @ret void
+ * @brief Unmaps the snapshot
+ */
+void ConfigSnapshot::Close()
+{
+	if (NULL != _mapAddress)
+	{
+		munmap(_mapAddress, _mapLength);
+	}
+	_mapAddress = NULL;
+	_mapLength = 0;
+	_header = NULL;
+}
+
+
+
+int ConfigSnapshot::GetUserCount() const
+{
+	return (NULL == _header) ? 0 : _header->userCount;
+}
+
+int ConfigSnapshot::GetServerCount() const
+{
+	return (NULL == _header) ? 0 : _header->serverCount;
+}
+
+const SnapshotUser* ConfigSnapshot::GetUser(int pIndex) const
+{
+	return (const SnapshotUser*) (_header + 1) + pIndex;
+}
+
+const SnapshotServer* ConfigSnapshot::GetServer(int pIndex) const
+{
+	return (const SnapshotServer*) ((const SnapshotUser*) (_header + 1) + _header->userCount) + pIndex;
+}
+
+long long ConfigSnapshot::GetCreatedTime() const
+{
+	return (NULL == _header) ? 0 : _header->createdTime;
+}
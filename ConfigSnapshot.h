@@ -0,0 +1,80 @@
+/**
+    @file ConfigSnapshot.h
+    @brief Declaration of the ConfigSnapshot class which keeps a local binary copy of the configuration loaded from the database
+
+	The snapshot holds the OSS users with their queue keys and the SPS servers. It is written to Conf/config.snap once the Session Layer
+	has loaded the configuration from the database, refreshed every SnapshotSaveIntervalSec seconds, and is read through mmap when the
+	database cannot be reached at start up. The file is written to a temporary file named after the process and renamed, so a reader
+	never sees a partial snapshot, even when several instances write it.
+
+	File layout : SnapshotHeader, followed by userCount SnapshotUser and serverCount SnapshotServer records.
+*/
+
+#ifndef _CONFIG_SNAPSHOT_H_
+#define _CONFIG_SNAPSHOT_H_
+
+#include <XMLIAClient.h>
+#include <vector>
+
+#define SNAPSHOT_MAGIC 		0x53435053		//!< "SPCS" identifying the snapshot file
+#define SNAPSHOT_VERSION 	1				//!< Version of the file layout, to be incremented on any change of the records
+
+namespace SPS
+{
+	struct SnapshotHeader
+	{
+		unsigned int 	magic;				//!< SNAPSHOT_MAGIC
+		unsigned int 	version;			//!< SNAPSHOT_VERSION
+		unsigned int 	userCount;			//!< Number of SnapshotUser records
+		unsigned int 	serverCount;		//!< Number of SnapshotServer records
+		long long 		createdTime;		//!< Time in epoch seconds at which the snapshot was written
+		unsigned int 	checksum;			//!< FNV-1a checksum of the records
+		unsigned int 	reserved;
+	};
+
+	struct SnapshotUser
+	{
+		char 	userName[64];
+		char 	password[64];
+		int 	requestQueueKey;
+		int 	responseQueueKey;
+		int 	maxConnection;
+		char 	touchFileName[1024];
+	};
+
+	struct SnapshotServer
+	{
+		char 	ipAddress[64];
+		int 	portNum;
+		int 	retryAttempt;
+		int 	retryInterval;
+		char 	spsHomePath[1024];
+	};
+
+	class ConfigSnapshot
+	{
+		public:
+			ConfigSnapshot();
+			~ConfigSnapshot();
+
+			static int Save(const char *pFileName, const std::vector<SnapshotUser> &pUsers, const SPSServerInfoVector &pServers);
+			static void FillUser(SnapshotUser &pRecord, const OSSUserInfo *pUser);
+
+			int Open(const char *pFileName);
+			void Close();
+			int GetUserCount() const;
+			int GetServerCount() const;
+			const SnapshotUser* GetUser(int pIndex) const;
+			const SnapshotServer* GetServer(int pIndex) const;
+			long long GetCreatedTime() const;
+
+		private:
+			static unsigned int checksum(const char *pData, size_t pLength);
+
+			void 			*_mapAddress;		//!< Address at which the snapshot is mapped, NULL if not open
+			size_t 			_mapLength;			//!< Length of the mapping
+			SnapshotHeader 	*_header;			//!< Header of the mapped snapshot
+	};
+}
+
+#endif
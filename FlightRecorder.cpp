@@ -0,0 +1,243 @@
+/**
+    @file FlightRecorder.cpp
+    @brief This file contains the definition for all the member functions of the FlightRecorder class
+
+*/
+
+#include <FlightRecorder.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+using namespace SPS;
+
+unsigned int 				FlightRecorder::_ringSize = 0;
+FlightRecorder::Ring 		*FlightRecorder::_rings[FLIGHT_MAX_RINGS];
+volatile int 				FlightRecorder::_ringCount = 0;
+__thread FlightRecorder::Ring 	*FlightRecorder::_threadRing = NULL;
+__thread bool 				FlightRecorder::_isAttachFailed = false;
+pthread_key_t 				FlightRecorder::_ringKey;
+
+
+
+/**
+ * @fn Init
+ * @param Number of events kept for each thread, rounded up to a power of 2. 0 disables the recorder
+ * @ret void
+ * @brief Should be invoked once before the XMLIAClient threads are started
+ */
+void FlightRecorder::Init(int pRingSize)
+{
+	unsigned int 	lSize = 1;		//!< Ring size rounded up to a power of 2
+
+	if (pRingSize <= 0)
+	{
+		_ringSize = 0;
+		return;
+	}
+	while (lSize < (unsigned int) pRingSize)
+	{
+		lSize <<= 1;
+	}
+	if (0 != pthread_key_create(&_ringKey, releaseRing))
+	{
+		_ringSize = 0;
+		return;
+	}
+	_ringSize = lSize;
+}//void FlightRecorder::Init(int pRingSize)
+
+
+
+/**
+ * @fn attachRing
+ * @param Nil
+ * @ret returns the ring of the calling thread, NULL if no ring is free and no more rings can be created
+ * @brief Takes the ring given back by an exited thread, else allocates a new ring, on the first record of the calling thread. The
+		rings are never freed, so that a dump can read them safely
+ */
+FlightRecorder::Ring* FlightRecorder::attachRing()
+{
+	Ring 	*lpRing = NULL;		//!< Ring of the calling thread
+	int 	lCount;				//!< Number of rings created
+	int 	lSlot;				//!< Index of the ring in _rings
+
+	lCount = _ringCount < FLIGHT_MAX_RINGS ? _ringCount : FLIGHT_MAX_RINGS;
+	for (lSlot = 0; lSlot < lCount && NULL == lpRing; lSlot++)
+	{
+		if (NULL != _rings[lSlot] && __sync_bool_compare_and_swap(&_rings[lSlot]->inUse, 0, 1))
+		{
+			lpRing = _rings[lSlot];
+		}
+	}
+
+	if (NULL == lpRing)
+	{
+		//! Allocating before taking a slot, so that a failed allocation takes no slot. The thread then records nothing
+		lpRing = (Ring*) calloc(1, sizeof(Ring));
+		if (NULL != lpRing && NULL == (lpRing->events = (FlightEvent*) calloc(_ringSize, sizeof(FlightEvent))))
+		{
+			free(lpRing);
+			lpRing = NULL;
+		}
+		if (NULL == lpRing)
+		{
+			_isAttachFailed = true;
+			return NULL;
+		}
+		lpRing->mask = _ringSize - 1;
+		lpRing->inUse = 1;
+
+		lSlot = __sync_fetch_and_add(&_ringCount, 1);
+		if (lSlot >= FLIGHT_MAX_RINGS)
+		{
+			__sync_fetch_and_sub(&_ringCount, 1);
+			free(lpRing->events);
+			free(lpRing);
+			return NULL;
+		}
+		lpRing->threadId = (unsigned int) syscall(SYS_gettid);
+		__sync_synchronize();
+		_rings[lSlot] = lpRing;
+	}
+	else
+	{
+		lpRing->threadId = (unsigned int) syscall(SYS_gettid);
+		lpRing->next = 0;
+	}
+
+	_threadRing = lpRing;
+	pthread_setspecific(_ringKey, lpRing);
+	return lpRing;
+}//FlightRecorder::Ring* FlightRecorder::attachRing()
+
+
+
+/**
+ * @fn releaseRing
+ * @param Ring of a thread which is exiting
+ * @ret void
+ * @brief Gives the ring back for the next thread. Invoked on FR_EXIT, and by the thread specific key when the thread exits without it
+ */
+void FlightRecorder::releaseRing(void *pRing)
+{
+	Ring 	*lpRing = (Ring*) pRing;
+
+	if (NULL != lpRing)
+	{
+		__sync_synchronize();
+		lpRing->inUse = 0;
+	}
+}
+
+
+
+/**
+ * @fn Record
+ * @param Stage which is starting
+ * @param mType of the request being served, 0 if none
+ * @ret void
+ */
+void FlightRecorder::Record(FlightStage pStage, long pMType)
+{
+	Ring 			*lpRing = _threadRing;		//!< Ring of the calling thread
+	FlightEvent 	*lpEvent;					//!< Slot to be filled
+	struct timespec lNow;						//!< Current monotonic time
+
+	if (0 == _ringSize)
+	{
+		return;
+	}
+	if (NULL == lpRing && (_isAttachFailed || NULL == (lpRing = attachRing())))
+	{
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &lNow);
+	lpEvent = &lpRing->events[lpRing->next & lpRing->mask];
+	lpEvent->timestamp = (unsigned long long) lNow.tv_sec * 1000000000ULL + lNow.tv_nsec;
+	lpEvent->mType = pMType;
+	lpEvent->stage = pStage;
+	lpRing->next++;
+
+	if (FR_EXIT == pStage)
+	{
+		_threadRing = NULL;
+		pthread_setspecific(_ringKey, NULL);
+		releaseRing(lpRing);
+	}
+}//void FlightRecorder::Record(FlightStage pStage, long pMType)
+
+
+
+/**
+ * @fn Dump
+ * @param Name of the file to which the rings are written
+ * @ret returns 0 on success and -1 on failure
+ * @brief Uses only async signal safe calls so that it can be invoked from the SIGUSR2 handler. The events being recorded while the dump
+		is in progress may be partially written, which is acceptable for the forensics.
+ */
+int FlightRecorder::Dump(const char *pFileName)
+{
+	FlightFileHeader 	lFileHeader;		//!< Header of the file
+	FlightRingHeader 	lRingHeader;		//!< Header of each ring
+	Ring 				*lpRing;			//!< Ring being written
+	unsigned long 		lNext;				//!< Snapshot of the number of events recorded in the ring
+	unsigned long 		lFirst;				//!< Oldest event still present in the ring
+	unsigned long 		lIndex;				//!< Used as index in loops
+	int 				lRingIndex;			//!< Used as index in loops
+	int 				lFd;				//!< Descriptor of the dump file
+	int 				lRingCount;			//!< Number of rings to be written
+
+	lFd = open(pFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (lFd < 0)
+	{
+		return -1;
+	}
+
+	lRingCount = _ringCount < FLIGHT_MAX_RINGS ? _ringCount : FLIGHT_MAX_RINGS;
+	while (0 < lRingCount && NULL == _rings[lRingCount - 1])
+	{
+		lRingCount--;
+	}
+
+	lFileHeader.magic = FLIGHT_FILE_MAGIC;
+	lFileHeader.version = FLIGHT_FILE_VERSION;
+	lFileHeader.ringCount = lRingCount;
+	lFileHeader.eventSize = sizeof(FlightEvent);
+	write(lFd, &lFileHeader, sizeof(lFileHeader));
+
+	for (lRingIndex = 0; lRingIndex < lRingCount; lRingIndex++)
+	{
+		lpRing = _rings[lRingIndex];
+		lNext = (NULL == lpRing) ? 0 : lpRing->next;
+		lFirst = (lNext > _ringSize) ? lNext - _ringSize : 0;
+
+		lRingHeader.threadId = (NULL == lpRing) ? 0 : lpRing->threadId;
+		lRingHeader.eventCount = lNext - lFirst;
+		write(lFd, &lRingHeader, sizeof(lRingHeader));
+
+		if (lNext == lFirst)
+		{
+			continue;
+		}
+
+		//! Writing the events oldest first, in two pieces when the ring has wrapped around
+		lIndex = lFirst & lpRing->mask;
+		if (lIndex + (lNext - lFirst) > _ringSize)
+		{
+			write(lFd, &lpRing->events[lIndex], (_ringSize - lIndex) * sizeof(FlightEvent));
+			write(lFd, &lpRing->events[0], (lNext & lpRing->mask) * sizeof(FlightEvent));
+		}
+		else
+		{
+			write(lFd, &lpRing->events[lIndex], (lNext - lFirst) * sizeof(FlightEvent));
+		}
+	}
+
+	close(lFd);
+	return 0;
+}//int FlightRecorder::Dump(const char *pFileName)
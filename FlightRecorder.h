@@ -0,0 +1,92 @@
+/**
+    @file FlightRecorder.h
+    @brief Declaration of the FlightRecorder class which keeps the recent stage timestamps of every XMLIAClient thread
+
+	Each thread records into its own ring buffer without any lock, so a record costs a monotonic clock read and a store. An event marks
+	the start of a stage and the stage lasts till the next event of the same thread. The rings are written to a binary file on SIGUSR2
+	or on a call to Dump, and Tools/FlightTrace converts the file to the Chrome trace JSON format. No part of the payload is recorded.
+	The ring of a thread is given back on FR_EXIT, or when the thread exits without it, and is reused by the next thread which starts, so
+	the threads replaced on reconnects do not use up the FLIGHT_MAX_RINGS rings. The events of an exited thread stay in the dumps till
+	its ring is reused.
+
+	File layout : FlightFileHeader, followed by a FlightRingHeader and its events for every thread.
+*/
+
+#ifndef _FLIGHT_RECORDER_H_
+#define _FLIGHT_RECORDER_H_
+
+#include <pthread.h>
+
+#define FLIGHT_FILE_MAGIC 		0x52465053		//!< "SPFR" identifying the flight recorder file
+#define FLIGHT_FILE_VERSION 	1				//!< Version of the file layout
+#define FLIGHT_MAX_RINGS 		1024			//!< Maximum number of threads which can record
+
+namespace SPS
+{
+	//! Stages recorded by the XMLIAClient threads. The order should match the names in Tools/FlightTrace.cpp
+	enum FlightStage
+	{
+		FR_QUEUE_WAIT = 0,		//!< Waiting for a request in the Request Message Queue
+		FR_DISPATCH,			//!< Request received, checking the header and the admission limits
+		FR_SEND,				//!< Sending the request to SPS
+		FR_RECV,				//!< Waiting for the response from SPS
+		FR_PUSH,				//!< Pushing the response to the Response Message Queue
+		FR_CONNECT,				//!< Connecting to SPS
+		FR_LOGIN,				//!< Logging in to SPS
+		FR_LOGOUT,				//!< Logging out from SPS
+		FR_EXIT,				//!< Thread exiting, ends the last stage
+		FR_MAX_STAGE
+	};
+
+	struct FlightEvent
+	{
+		unsigned long long 	timestamp;		//!< CLOCK_MONOTONIC time in nanoseconds at which the stage started
+		long long 			mType;			//!< mType of the request being served, 0 if none
+		unsigned int 		stage;			//!< FlightStage
+		unsigned int 		reserved;		//!< Keeps the event aligned to 8 bytes
+	};
+
+	struct FlightFileHeader
+	{
+		unsigned int 	magic;				//!< FLIGHT_FILE_MAGIC
+		unsigned int 	version;			//!< FLIGHT_FILE_VERSION
+		unsigned int 	ringCount;			//!< Number of rings in the file
+		unsigned int 	eventSize;			//!< sizeof(FlightEvent)
+	};
+
+	struct FlightRingHeader
+	{
+		unsigned int 	threadId;			//!< Kernel thread id of the thread owning the ring
+		unsigned int 	eventCount;			//!< Number of events following the header, oldest first
+	};
+
+	class FlightRecorder
+	{
+		public:
+			static void Init(int pRingSize);
+			static void Record(FlightStage pStage, long pMType);
+			static int Dump(const char *pFileName);
+
+		private:
+			struct Ring
+			{
+				unsigned int 		threadId;		//!< Kernel thread id of the owner
+				unsigned int 		mask;			//!< Ring size - 1, the ring size is a power of 2
+				volatile unsigned long 	next;		//!< Total number of events recorded so far
+				volatile int 		inUse;			//!< Set while a thread owns the ring
+				FlightEvent 		*events;		//!< Ring of events
+			};
+
+			static Ring* attachRing();
+			static void releaseRing(void *pRing);
+
+			static unsigned int 	_ringSize;						//!< Number of events in each ring, 0 when disabled
+			static Ring 			*_rings[FLIGHT_MAX_RINGS];		//!< Rings of all the threads
+			static volatile int 	_ringCount;						//!< Number of rings in use
+			static __thread Ring 	*_threadRing;					//!< Ring of the calling thread
+			static __thread bool 	_isAttachFailed;				//!< Set when the ring of the calling thread could not be allocated
+			static pthread_key_t 	_ringKey;						//!< Gives back the ring of a thread exiting without FR_EXIT
+	};
+}
+
+#endif
@@ -0,0 +1,254 @@
+/**
+    @file HeartbeatMonitor.cpp
+    @brief This file contains the definition for all the member functions of the HeartbeatMonitor class
+
+*/
+
+#include <HeartbeatMonitor.h>
+#include <RequestHeader.h>
+#include <SessionConfig.h>
+#include <SessionStats.h>
+#include <QueueShards.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace SPS;
+
+extern ABL_Logger gABLLoggerObj;    //!< Global ABL Logger Object for logging
+
+pthread_once_t 						HeartbeatMonitor::_once = PTHREAD_ONCE_INIT;
+pthread_mutex_t 					HeartbeatMonitor::_mutex = PTHREAD_MUTEX_INITIALIZER;
+int 								HeartbeatMonitor::_interval = 0;
+std::map<XMLIAClient*, volatile long long*> 	HeartbeatMonitor::_lastActivity;
+std::map<OSSUserInfo*, int> 		HeartbeatMonitor::_pendingPings;
+
+
+
+/**
+ * @fn SetKeepAlive
+ * @param Socket descriptor connected to SPS
+ * @ret void
+ * @brief Enables the TCP keepalive on the socket, so that the kernel detects the peers which disappeared without closing the connection
+ */
+void HeartbeatMonitor::SetKeepAlive(int pSocketDesc)
+{
+	int 	lOn = 1;			//!< Used to enable the keepalive
+	int 	lIdle;				//!< Seconds of idle time before the first probe
+	int 	lInterval;			//!< Seconds between the probes
+	int 	lCount;				//!< Number of unanswered probes after which the connection is dropped
+
+	lIdle = SessionConfig::GetInt("TcpKeepAliveIdleSec", 60);
+	if (lIdle <= 0)
+	{
+		return;
+	}
+	lInterval = SessionConfig::GetInt("TcpKeepAliveIntervalSec", 10);
+	lCount = SessionConfig::GetInt("TcpKeepAliveCount", 3);
+
+	setsockopt(pSocketDesc, SOL_SOCKET, SO_KEEPALIVE, &lOn, sizeof(lOn));
+	setsockopt(pSocketDesc, IPPROTO_TCP, TCP_KEEPIDLE, &lIdle, sizeof(lIdle));
+	setsockopt(pSocketDesc, IPPROTO_TCP, TCP_KEEPINTVL, &lInterval, sizeof(lInterval));
+	setsockopt(pSocketDesc, IPPROTO_TCP, TCP_KEEPCNT, &lCount, sizeof(lCount));
+}//void HeartbeatMonitor::SetKeepAlive(int pSocketDesc)
+
+
+
+/**
+ * @fn Start
+ * @param Nil
+ * @ret void
+ * @brief Starts the monitor thread on the first call. Invoked from XMLIAClient::Start
+ */
+void HeartbeatMonitor::Start()
+{
+	pthread_once(&_once, startOnce);
+}
+
+void HeartbeatMonitor::startOnce()
+{
+	pthread_t 	lThreadId;		//!< Monitor thread
+
+	_interval = SessionConfig::GetInt("HeartbeatIntervalSec", 0);
+	if (_interval <= 0)
+	{
+		return;
+	}
+	if (0 == pthread_create(&lThreadId, NULL, monitorThread, NULL))
+	{
+		pthread_detach(lThreadId);
+	}
+}//void HeartbeatMonitor::startOnce()
+
+
+
+/**
+ * @fn Attach
+ * @param XMLIAClient whose thread is starting
+ * @ret returns the activity time of the connection, to be passed to Touch, NULL when the heartbeats are disabled
+ * @brief Invoked once by the XMLIAClient thread, so that recording the activity later takes no lock
+ */
+volatile long long* HeartbeatMonitor::Attach(XMLIAClient *pClient)
+{
+	volatile long long 	*lpActivity;	//!< Activity time of the connection
+
+	if (_interval <= 0)
+	{
+		return NULL;
+	}
+	lpActivity = new long long(RequestHeader::NowMillis());
+
+	pthread_mutex_lock(&_mutex);
+	if (_lastActivity.end() != _lastActivity.find(pClient))
+	{
+		delete _lastActivity[pClient];
+	}
+	_lastActivity[pClient] = lpActivity;
+	pthread_mutex_unlock(&_mutex);
+	return lpActivity;
+}//volatile long long* HeartbeatMonitor::Attach(XMLIAClient *pClient)
+
+
+
+/**
+ * @fn Touch
+ * @param Activity time of the connection, as returned by Attach
+ * @ret void
+ * @brief Records the activity of the connection. Invoked by the XMLIAClient thread before waiting for a request and after every
+		request. Only the thread writes the time and an aligned 64 bit store is atomic, so no lock is taken
+ */
+void HeartbeatMonitor::Touch(volatile long long *pActivity)
+{
+	if (NULL != pActivity)
+	{
+		*pActivity = RequestHeader::NowMillis();
+	}
+}
+
+
+
+/**
+ * @fn Remove
+ * @param XMLIAClient whose thread is exiting
+ * @ret void
+ */
+void HeartbeatMonitor::Remove(XMLIAClient *pClient)
+{
+	std::map<XMLIAClient*, volatile long long*>::iterator 	lIter;
+
+	pthread_mutex_lock(&_mutex);
+	lIter = _lastActivity.find(pClient);
+	if (lIter != _lastActivity.end())
+	{
+		delete lIter->second;
+		_lastActivity.erase(lIter);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+
+
+/**
+ * @fn Consumed
+ * @param User whose PING message was picked up
+ * @ret void
+ */
+void HeartbeatMonitor::Consumed(OSSUserInfo *pUser)
+{
+	pthread_mutex_lock(&_mutex);
+	if (0 < _pendingPings[pUser])
+	{
+		_pendingPings[pUser]--;
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+
+
+/**
+ * @fn sendPings
+ * @param Nil
+ * @ret void
+ * @brief Pushes one PING message for every connection idle for the whole interval. No PING is pushed for a user while the earlier
+		ones are still waiting in the queue, so that a user without any free thread is not flooded.
+ */
+void HeartbeatMonitor::sendPings()
+{
+	std::map<OSSUserInfo*, int> 					lIdleCount;		//!< Idle connections of each user
+	std::map<OSSUserInfo*, int>::iterator 			lUserIter;
+	std::map<std::pair<OSSUserInfo*, int>, int> 	lShardIdleCount;	//!< Idle connections tied to each shard of each user
+	std::map<std::pair<OSSUserInfo*, int>, int>::iterator 	lShardIter;
+	std::map<XMLIAClient*, volatile long long*>::iterator 	lIter;
+	MsqQueStruct 	lPingMsg;			//!< PING message
+	long long 		lNow;				//!< Current time in epoch milliseconds
+	int 			lQueueId;			//!< Id of the Request Message Queue of the user
+	int 			lIndex;				//!< Used as index in loops
+	int 			lShard;				//!< Shard to which an idle thread is tied
+
+	lNow = RequestHeader::NowMillis();
+
+	pthread_mutex_lock(&_mutex);
+	for (lIter = _lastActivity.begin(); lIter != _lastActivity.end(); lIter++)
+	{
+		if (lIter->first->isConnected && lNow - *lIter->second >= _interval * 1000LL && 0 == _pendingPings[lIter->first->pOssUserInfo])
+		{
+			lShard = QueueShards::GetShard(lIter->first);
+			if (lShard < 0)
+			{
+				continue;
+			}
+			lIdleCount[lIter->first->pOssUserInfo]++;
+			lShardIdleCount[std::make_pair(lIter->first->pOssUserInfo, lShard)]++;
+		}
+	}
+	for (lUserIter = lIdleCount.begin(); lUserIter != lIdleCount.end(); lUserIter++)
+	{
+		_pendingPings[lUserIter->first] = lUserIter->second;
+	}
+	pthread_mutex_unlock(&_mutex);
+
+	memset(&lPingMsg, '\0', sizeof(lPingMsg));
+	lPingMsg.mType = HEARTBEAT_MTYPE;
+	strcpy(lPingMsg.xmlRequest, "PING");
+
+	//! The PING messages go to the Request Message Queue of the shard the idle threads are tied to
+	for (lShardIter = lShardIdleCount.begin(); lShardIter != lShardIdleCount.end(); lShardIter++)
+	{
+		lQueueId = QueueShards::GetRequestQueueId(lShardIter->first.first, lShardIter->first.second);
+		for (lIndex = 0; lIndex < lShardIter->second; lIndex++)
+		{
+			if (lQueueId < 0 || 0 != msgsnd(lQueueId, &lPingMsg, sizeof(lPingMsg.xmlRequest), IPC_NOWAIT))
+			{
+				Consumed(lShardIter->first.first);
+				continue;
+			}
+			SessionStats::Increment(HEARTBEATS_SENT);
+		}
+	}
+}//void HeartbeatMonitor::sendPings()
+
+
+
+/**
+ * @fn monitorThread
+ * @param Nil
+ * @ret NULL
+ */
+void* HeartbeatMonitor::monitorThread(void *pArg)
+{
+	char 	lLogMsgBuf[1024];	//!< Logger Message Buffer
+	char 	lCounters[900];		//!< Counters of the Session Layer
+
+	gABLLoggerObj<<INFO<<"Heartbeat Monitor Started"<<Endl;
+	while (true)
+	{
+		sleep(_interval);
+		sendPings();
+
+		//! Writing the counters along with the heartbeat, so that the heartbeat results are visible in the log
+		SessionStats::Format(lCounters, sizeof(lCounters));
+		snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Session Counters : %s", lCounters);
+		gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+	}
+	return NULL;
+}//void* HeartbeatMonitor::monitorThread(void *pArg)
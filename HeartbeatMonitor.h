@@ -0,0 +1,46 @@
+/**
+    @file HeartbeatMonitor.h
+    @brief Declaration of the HeartbeatMonitor class which detects the dead SPS connections while they are idle
+
+	The XMLIAClient threads block on the Request Message Queue while idle, so the monitor cannot use their sockets directly. Every
+	HeartbeatIntervalSec seconds it counts the connections of each user which were idle for the whole interval and pushes that many
+	PING messages (mType 123124, understood by the XMLIAClient) into the Request Message Queue of the user (of the shard the idle threads are tied to). The longest waiting threads
+	pick them up, check their socket and send HeartbeatRequest to SPS when configured. A dead connection is replaced right away, before
+	any request of the Service Layer reaches it.
+*/
+
+#ifndef _HEARTBEAT_MONITOR_H_
+#define _HEARTBEAT_MONITOR_H_
+
+#include <XMLIAClient.h>
+#include <map>
+#include <pthread.h>
+
+#define HEARTBEAT_MTYPE 	123124		//!< mType of the PING message, hardcoded and understood by the XMLIAClient
+
+namespace SPS
+{
+	class HeartbeatMonitor
+	{
+		public:
+			static void Start();
+			static volatile long long* Attach(XMLIAClient *pClient);
+			static void Touch(volatile long long *pActivity);
+			static void Remove(XMLIAClient *pClient);
+			static void Consumed(OSSUserInfo *pUser);
+			static void SetKeepAlive(int pSocketDesc);
+
+		private:
+			static void* monitorThread(void *pArg);
+			static void startOnce();
+			static void sendPings();
+
+			static pthread_once_t 						_once;				//!< Makes sure only one monitor thread is started
+			static pthread_mutex_t 						_mutex;				//!< Protects the maps
+			static int 									_interval;			//!< Seconds between the heartbeats, 0 when disabled
+			static std::map<XMLIAClient*, volatile long long*> 	_lastActivity;	//!< Time in epoch milliseconds of the last activity of each connection, written by its thread without the mutex
+			static std::map<OSSUserInfo*, int> 			_pendingPings;		//!< PING messages not yet picked up for each user
+	};
+}
+
+#endif
@@ -0,0 +1,603 @@
+/**
+    @file LeaseManager.cpp
+    @brief This file contains the definition for all the member functions of the LeaseManager class
+
+*/
+
+#include <LeaseManager.h>
+#include <QueueShards.h>
+#include <HeartbeatMonitor.h>
+#include <SessionConfig.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <utime.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace SPS;
+
+extern ABL_Logger gABLLoggerObj;    //!< Global ABL Logger Object for logging
+
+pthread_mutex_t 				LeaseManager::_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t 				LeaseManager::_roundMutex = PTHREAD_MUTEX_INITIALIZER;
+bool 							LeaseManager::_isStopped = false;
+char 							LeaseManager::_instanceId[128] = "";
+char 							LeaseManager::_leaseDir[1024] = "";
+char 							LeaseManager::_instanceFile[1200] = "";
+int 							LeaseManager::_renewInterval = 5;
+int 							LeaseManager::_timeout = 20;
+std::map<OSSUserInfo*, int> 	LeaseManager::_users;
+std::set<ShardLease> 			LeaseManager::_owned;
+
+
+
+/**
+ * @fn Start
+ * @param Name of this instance, empty when only one instance is run
+ * @param Directory holding the instance and lease files
+ * @ret returns 0 on success and -1 if a live instance with the same name is present or the lease directory cannot be used
+ * @brief Announces this instance in the lease directory and starts the thread which renews and rebalances the leases. Should be invoked
+		before the users are created, so that the shards are taken before the XMLIAClient threads start
+ */
+int LeaseManager::Start(const char *pInstanceId, const char *pLeaseDir)
+{
+	char 		lMkdirCmd[1100];	//!< Command to create the lease directory
+	char 		lContent[256];		//!< Host and process of this instance, written to the instance file
+	pthread_t 	lThreadId;			//!< Lease thread
+	int 		lFd;				//!< Instance file
+
+	if (NULL == pInstanceId || '\0' == *pInstanceId)
+	{
+		return 0;
+	}
+
+	strncpy(_instanceId, pInstanceId, sizeof(_instanceId) - 1);
+	strncpy(_leaseDir, pLeaseDir, sizeof(_leaseDir) - 1);
+	snprintf(_instanceFile, sizeof(_instanceFile), "%s/instance.%s", _leaseDir, _instanceId);
+	_renewInterval = SessionConfig::GetInt("LeaseRenewSec", 5);
+	_timeout = SessionConfig::GetInt("LeaseTimeoutSec", 20);
+
+	snprintf(lMkdirCmd, sizeof(lMkdirCmd), "mkdir -p %s", _leaseDir);
+	system(lMkdirCmd);
+
+	//! An instance file touched within the timeout means another process is running with the same name
+	_instanceId[0] = '\0';
+	if (isLive(pInstanceId))
+	{
+		return -1;
+	}
+	strncpy(_instanceId, pInstanceId, sizeof(_instanceId) - 1);
+
+	lFd = open(_instanceFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (lFd < 0)
+	{
+		_instanceId[0] = '\0';
+		return -1;
+	}
+	gethostname(lContent, 128);
+	lContent[127] = '\0';
+	sprintf(lContent + strlen(lContent), " %d\n", (int) getpid());
+	write(lFd, lContent, strlen(lContent));
+	close(lFd);
+
+	if (0 == pthread_create(&lThreadId, NULL, leaseThread, NULL))
+	{
+		pthread_detach(lThreadId);
+	}
+	return 0;
+}//int LeaseManager::Start(const char *pInstanceId, const char *pLeaseDir)
+
+
+
+/**
+ * @fn Stop
+ * @param Nil
+ * @ret void
+ * @brief Gives up all the leases and removes the instance file, so that the other instances take over the shards on their next round
+		instead of waiting for the timeout. Invoked once the users are stopped
+ */
+void LeaseManager::Stop()
+{
+	std::set<ShardLease>::iterator 	lIter;
+
+	if ('\0' == _instanceId[0])
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&_roundMutex);
+	_isStopped = true;
+	for (lIter = _owned.begin(); lIter != _owned.end(); lIter++)
+	{
+		release(*lIter);
+	}
+	pthread_mutex_lock(&_mutex);
+	_owned.clear();
+	pthread_mutex_unlock(&_mutex);
+	remove(_instanceFile);
+	pthread_mutex_unlock(&_roundMutex);
+}//void LeaseManager::Stop()
+
+
+
+/**
+ * @fn GetInstanceId
+ * @param Nil
+ * @ret returns the name of this instance, empty when leases are not used
+ */
+const char* LeaseManager::GetInstanceId()
+{
+	return _instanceId;
+}
+
+
+
+/**
+ * @fn Register
+ * @param User whose queues are created
+ * @param Number of shards of the user
+ * @ret void
+ * @brief Adds the shards of the user to the leases and takes this instance's share of them. Invoked from QueueShards::Create
+ */
+void LeaseManager::Register(OSSUserInfo *pUser, int pShardCount)
+{
+	char 	lLogMsgBuf[512];	//!< Logger Message Buffer
+
+	if ('\0' == _instanceId[0])
+	{
+		return;
+	}
+
+	//! A shard is read by one instance at a time, so a user with a single shard gains nothing from the other instances
+	if (pShardCount < 2)
+	{
+		snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Single Queue Shard for User : %s | Only one instance serves it, set QueueShards.%s to at least the number of instances", pUser->userName, pUser->userName);
+		gABLLoggerObj<<_ERROR<<lLogMsgBuf<<Endl;
+	}
+
+	pthread_mutex_lock(&_mutex);
+	_users[pUser] = pShardCount;
+	pthread_mutex_unlock(&_mutex);
+
+	balance();
+}//void LeaseManager::Register(OSSUserInfo *pUser, int pShardCount)
+
+
+
+/**
+ * @fn Unregister
+ * @param User whose queues are removed
+ * @ret void
+ * @brief Gives up the leases of the user. Invoked from QueueShards::Remove
+ */
+void LeaseManager::Unregister(OSSUserInfo *pUser)
+{
+	std::set<ShardLease>::iterator 	lIter;
+
+	if ('\0' == _instanceId[0])
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&_roundMutex);
+	pthread_mutex_lock(&_mutex);
+	for (lIter = _owned.begin(); lIter != _owned.end(); )
+	{
+		if (pUser == lIter->first)
+		{
+			release(*lIter);
+			_owned.erase(lIter++);
+		}
+		else
+		{
+			lIter++;
+		}
+	}
+	_users.erase(pUser);
+	pthread_mutex_unlock(&_mutex);
+	pthread_mutex_unlock(&_roundMutex);
+}//void LeaseManager::Unregister(OSSUserInfo *pUser)
+
+
+
+/**
+ * @fn IsOwned
+ * @param User
+ * @param Shard
+ * @ret returns true if this instance holds the lease of the shard, always true when leases are not used
+ */
+bool LeaseManager::IsOwned(OSSUserInfo *pUser, int pShard)
+{
+	bool 	lIsOwned;
+
+	if ('\0' == _instanceId[0])
+	{
+		return true;
+	}
+
+	pthread_mutex_lock(&_mutex);
+	lIsOwned = (_owned.end() != _owned.find(ShardLease(pUser, pShard)));
+	pthread_mutex_unlock(&_mutex);
+	return lIsOwned;
+}
+
+
+
+/**
+ * @fn IsLastInstance
+ * @param Nil
+ * @ret returns true if no other instance is live, always true when leases are not used
+ * @brief The touch file of a user is shared by all the instances, so it is removed only by the last instance serving the user
+ */
+bool LeaseManager::IsLastInstance()
+{
+	if ('\0' == _instanceId[0])
+	{
+		return true;
+	}
+	return (getLiveInstances() <= 1);
+}
+
+
+
+/**
+ * @fn HashInstanceId
+ * @param Name of an instance
+ * @ret returns the 14 bit FNV-1a hash of the name, which names the stop messages of the instance
+ */
+unsigned int LeaseManager::HashInstanceId(const char *pInstanceId)
+{
+	unsigned int 	lHash = 2166136261U;	//!< FNV-1a hash of the name
+
+	for (; '\0' != *pInstanceId; pInstanceId++)
+	{
+		lHash = (lHash ^ (unsigned char) *pInstanceId) * 16777619U;
+	}
+	return (lHash & 0x3FFF);
+}
+
+
+
+/**
+ * @fn IsLiveInstance
+ * @param Hash of the name of an instance, as returned by HashInstanceId
+ * @ret returns true if a live instance has the hash. Without leases only this instance is live
+ * @brief Scans the lease directory, so it is meant for the rare stop messages of other instances and not for every request
+ */
+bool LeaseManager::IsLiveInstance(unsigned int pHash)
+{
+	DIR 			*lpDir;				//!< Lease directory
+	struct dirent 	*lpEntry;			//!< File in the lease directory
+	bool 			lIsLive = false;	//!< Set once a live instance with the hash is found
+
+	if (HashInstanceId(_instanceId) == pHash)
+	{
+		return true;
+	}
+	if ('\0' == _instanceId[0])
+	{
+		return false;
+	}
+
+	lpDir = opendir(_leaseDir);
+	while (!lIsLive && NULL != lpDir && NULL != (lpEntry = readdir(lpDir)))
+	{
+		lIsLive = (0 == strncmp(lpEntry->d_name, "instance.", 9) && HashInstanceId(lpEntry->d_name + 9) == pHash && isLive(lpEntry->d_name + 9));
+	}
+	if (NULL != lpDir)
+	{
+		closedir(lpDir);
+	}
+	return lIsLive;
+}//bool LeaseManager::IsLiveInstance(unsigned int pHash)
+
+
+
+/**
+ * @fn leaseThread
+ * @param Nil
+ * @ret NULL
+ */
+void* LeaseManager::leaseThread(void *pArg)
+{
+	gABLLoggerObj<<INFO<<"Lease Manager Started"<<Endl;
+	while (!_isStopped)
+	{
+		sleep(_renewInterval);
+		balance();
+	}
+	return NULL;
+}//void* LeaseManager::leaseThread(void *pArg)
+
+
+
+/**
+ * @fn balance
+ * @param Nil
+ * @ret void
+ * @brief One round of the lease protocol. Renews this instance, drops the leases taken over by another instance, gives up the leases
+		above the fair share and takes free or abandoned leases up to the fair share. The fair share is the number of shards of all the
+		users divided by the number of live instances, rounded up
+ */
+void LeaseManager::balance()
+{
+	std::vector<ShardLease> 				lAllLeases;		//!< Shards of all the registered users
+	std::vector<ShardLease> 				lWakeLeases;	//!< Leases given up or lost in this round
+	std::set<ShardLease> 					lOwned;			//!< Leases held at the end of the round
+	std::set<ShardLease>::iterator 			lOwnedIter;
+	std::map<OSSUserInfo*, int>::iterator 	lUserIter;
+	char 				lOwner[128];		//!< Owner written in a lease file
+	char 				lLogMsgBuf[512];	//!< Logger Message Buffer
+	int 				lLiveCount;			//!< Number of live instances including this one
+	int 				lFairShare;			//!< Number of leases this instance should hold
+	int 				lIndex;				//!< Used as index in loops
+
+	pthread_mutex_lock(&_roundMutex);
+	if (_isStopped)
+	{
+		pthread_mutex_unlock(&_roundMutex);
+		return;
+	}
+
+	//! Renewing this instance. The file is created again if it was removed from the directory
+	if (0 != utime(_instanceFile, NULL))
+	{
+		close(open(_instanceFile, O_WRONLY | O_CREAT, 0644));
+	}
+	lLiveCount = getLiveInstances();
+
+	pthread_mutex_lock(&_mutex);
+	for (lUserIter = _users.begin(); lUserIter != _users.end(); lUserIter++)
+	{
+		for (lIndex = 0; lIndex < lUserIter->second; lIndex++)
+		{
+			lAllLeases.push_back(ShardLease(lUserIter->first, lIndex));
+		}
+	}
+	lOwned = _owned;
+	pthread_mutex_unlock(&_mutex);
+
+	//! A lease whose file names another instance was taken over while this instance was not renewing
+	for (lOwnedIter = lOwned.begin(); lOwnedIter != lOwned.end(); )
+	{
+		if (readOwner(*lOwnedIter, lOwner, sizeof(lOwner)) && 0 == strcmp(lOwner, _instanceId))
+		{
+			lOwnedIter++;
+			continue;
+		}
+		snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Lease Lost | User : %s | Shard : %d", lOwnedIter->first->userName, lOwnedIter->second);
+		gABLLoggerObj<<_ERROR<<lLogMsgBuf<<Endl;
+		lWakeLeases.push_back(*lOwnedIter);
+		lOwned.erase(lOwnedIter++);
+	}
+
+	lFairShare = (lAllLeases.size() + lLiveCount - 1) / lLiveCount;
+
+	while (lOwned.size() > lFairShare)
+	{
+		lOwnedIter = --lOwned.end();
+		release(*lOwnedIter);
+		snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Lease Released | User : %s | Shard : %d | Live Instances : %d", lOwnedIter->first->userName, lOwnedIter->second, lLiveCount);
+		gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+		lWakeLeases.push_back(*lOwnedIter);
+		lOwned.erase(lOwnedIter);
+	}
+
+	for (lIndex = 0; lIndex < lAllLeases.size() && lOwned.size() < lFairShare; lIndex++)
+	{
+		if (lOwned.end() == lOwned.find(lAllLeases[lIndex]) && acquire(lAllLeases[lIndex]))
+		{
+			snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Lease Acquired | User : %s | Shard : %d | Live Instances : %d", lAllLeases[lIndex].first->userName, lAllLeases[lIndex].second, lLiveCount);
+			gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+			lOwned.insert(lAllLeases[lIndex]);
+		}
+	}
+
+	//! Users unregistered during the round are not taken back in
+	pthread_mutex_lock(&_mutex);
+	_owned.clear();
+	for (lOwnedIter = lOwned.begin(); lOwnedIter != lOwned.end(); lOwnedIter++)
+	{
+		if (_users.end() != _users.find(lOwnedIter->first))
+		{
+			_owned.insert(*lOwnedIter);
+		}
+	}
+	pthread_mutex_unlock(&_mutex);
+	pthread_mutex_unlock(&_roundMutex);
+
+	for (lIndex = 0; lIndex < lWakeLeases.size(); lIndex++)
+	{
+		wakeThreads(lWakeLeases[lIndex]);
+	}
+}//void LeaseManager::balance()
+
+
+
+/**
+ * @fn getLiveInstances
+ * @param Nil
+ * @ret returns the number of instances whose file was touched within the timeout, at least 1 for this instance
+ */
+int LeaseManager::getLiveInstances()
+{
+	DIR 			*lpDir;			//!< Lease directory
+	struct dirent 	*lpEntry;		//!< File in the lease directory
+	int 			lCount = 0;		//!< Live instances
+
+	lpDir = opendir(_leaseDir);
+	while (NULL != lpDir && NULL != (lpEntry = readdir(lpDir)))
+	{
+		if (0 == strncmp(lpEntry->d_name, "instance.", 9) && isLive(lpEntry->d_name + 9))
+		{
+			lCount++;
+		}
+	}
+	if (NULL != lpDir)
+	{
+		closedir(lpDir);
+	}
+	return (0 == lCount) ? 1 : lCount;
+}//int LeaseManager::getLiveInstances()
+
+
+
+/**
+ * @fn isLive
+ * @param Name of an instance
+ * @ret returns true if the instance file was touched within the timeout
+ */
+bool LeaseManager::isLive(const char *pInstanceId)
+{
+	char 			lFileName[1200];	//!< Instance file
+	struct stat 	lFileInfo;			//!< Status of the instance file
+
+	if (0 == strcmp(pInstanceId, _instanceId))
+	{
+		return true;
+	}
+	snprintf(lFileName, sizeof(lFileName), "%s/instance.%s", _leaseDir, pInstanceId);
+	return (0 == stat(lFileName, &lFileInfo) && time(NULL) - lFileInfo.st_mtime <= _timeout);
+}
+
+
+
+/**
+ * @fn readOwner
+ * @param Lease
+ * @param Buffer to which the owner is read
+ * @param Length of the buffer
+ * @ret returns true if the lease file is present and names an owner
+ */
+bool LeaseManager::readOwner(const ShardLease &pLease, char *pOwner, int pLen)
+{
+	char 	lFileName[1400];	//!< Lease file
+	int 	lFd;				//!< Lease file
+	int 	lRead;				//!< Bytes read
+
+	leaseFileName(pLease, lFileName, sizeof(lFileName));
+	lFd = open(lFileName, O_RDONLY);
+	if (lFd < 0)
+	{
+		return false;
+	}
+	lRead = read(lFd, pOwner, pLen - 1);
+	close(lFd);
+	pOwner[(lRead < 0) ? 0 : lRead] = '\0';
+	return ('\0' != pOwner[0]);
+}//bool LeaseManager::readOwner(const ShardLease &pLease, char *pOwner, int pLen)
+
+
+
+/**
+ * @fn acquire
+ * @param Lease
+ * @ret returns true if this instance holds the lease
+ * @brief Creates the lease file if no instance holds it. The lease of a gone instance is taken over by renaming a new file over it,
+		and is held only if the file names this instance when read back, as another instance may take it over at the same time
+ */
+bool LeaseManager::acquire(const ShardLease &pLease)
+{
+	char 	lFileName[1400];	//!< Lease file
+	char 	lTempName[1600];	//!< File renamed over the lease file of a gone instance
+	char 	lOwner[128];		//!< Owner written in the lease file
+	int 	lFd;				//!< Lease file
+
+	leaseFileName(pLease, lFileName, sizeof(lFileName));
+	lFd = open(lFileName, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (0 <= lFd)
+	{
+		write(lFd, _instanceId, strlen(_instanceId));
+		close(lFd);
+		return true;
+	}
+	if (EEXIST != errno || !readOwner(pLease, lOwner, sizeof(lOwner)))
+	{
+		return false;
+	}
+	if (isLive(lOwner))
+	{
+		return (0 == strcmp(lOwner, _instanceId));
+	}
+
+	snprintf(lTempName, sizeof(lTempName), "%s.%s.tmp", lFileName, _instanceId);
+	lFd = open(lTempName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (lFd < 0)
+	{
+		return false;
+	}
+	write(lFd, _instanceId, strlen(_instanceId));
+	close(lFd);
+	if (0 != rename(lTempName, lFileName))
+	{
+		remove(lTempName);
+		return false;
+	}
+	return (readOwner(pLease, lOwner, sizeof(lOwner)) && 0 == strcmp(lOwner, _instanceId));
+}//bool LeaseManager::acquire(const ShardLease &pLease)
+
+
+
+/**
+ * @fn release
+ * @param Lease
+ * @ret void
+ * @brief Removes the lease file if it still names this instance
+ */
+void LeaseManager::release(const ShardLease &pLease)
+{
+	char 	lFileName[1400];	//!< Lease file
+	char 	lOwner[128];		//!< Owner written in the lease file
+
+	if (readOwner(pLease, lOwner, sizeof(lOwner)) && 0 == strcmp(lOwner, _instanceId))
+	{
+		leaseFileName(pLease, lFileName, sizeof(lFileName));
+		remove(lFileName);
+	}
+}
+
+
+
+/**
+ * @fn leaseFileName
+ * @param Lease
+ * @param Buffer to which the file name is written
+ * @param Length of the buffer
+ * @ret void
+ * @brief The lease is named after the user name, which is the same in all the instances
+ */
+void LeaseManager::leaseFileName(const ShardLease &pLease, char *pFileName, int pLen)
+{
+	snprintf(pFileName, pLen, "%s/lease.%s.%d", _leaseDir, pLease.first->userName, pLease.second);
+}
+
+
+
+/**
+ * @fn wakeThreads
+ * @param Lease given up or lost
+ * @ret void
+ * @brief Pushes a PING message for every thread tied to the shard. The threads blocked on the queue of the shard pick them up, find the
+		shard is no more held and move to a shard this instance holds. A PING picked up by a thread of another instance is only a
+		heartbeat check for it
+ */
+void LeaseManager::wakeThreads(const ShardLease &pLease)
+{
+	MsqQueStruct 	lPingMsg;		//!< PING message
+	int 			lQueueId;		//!< Request Message Queue of the shard
+	int 			lCount;			//!< Threads tied to the shard
+	int 			lIndex;			//!< Used as index in loops
+
+	memset(&lPingMsg, '\0', sizeof(lPingMsg));
+	lPingMsg.mType = HEARTBEAT_MTYPE;
+	strcpy(lPingMsg.xmlRequest, "PING");
+
+	lQueueId = QueueShards::GetRequestQueueId(pLease.first, pLease.second);
+	lCount = QueueShards::GetThreadCount(pLease.first, pLease.second);
+	for (lIndex = 0; 0 <= lQueueId && lIndex < lCount; lIndex++)
+	{
+		msgsnd(lQueueId, &lPingMsg, sizeof(lPingMsg.xmlRequest), IPC_NOWAIT);
+	}
+}//void LeaseManager::wakeThreads(const ShardLease &pLease)
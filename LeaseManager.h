@@ -0,0 +1,67 @@
+/**
+    @file LeaseManager.h
+    @brief Declaration of the LeaseManager class which splits the queue shards of the users between cooperating Session Layer instances
+
+	Each instance started with SESSION_LAYER_INSTANCE set has a name and keeps the file instance.<name> in the lease directory touched
+	every LeaseRenewSec seconds. An instance whose file was not touched for LeaseTimeoutSec seconds is taken as gone. Every shard of
+	every user is a lease, held by the instance whose name is written in the file lease.<user name>.<shard>. Every LeaseRenewSec seconds
+	each instance counts the live instances, gives up the leases above its fair share and takes free leases, or the leases of the gone
+	instances, up to its fair share. So the shards are rebalanced within a few rounds when an instance joins or leaves.
+
+	The XMLIAClient threads of an instance serve only the shards it holds. The lease directory defaults to Leases/<host name> under the
+	SESSION_LAYER_HOME path, as the Message Queues are local to the host. Without an instance name every shard is held, as before.
+	A user with a single shard is served by one instance only, the SPS connections of the user in the other instances stay idle.
+*/
+
+#ifndef _LEASE_MANAGER_H_
+#define _LEASE_MANAGER_H_
+
+#include <OSSUserInfo.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <pthread.h>
+
+namespace SPS
+{
+	typedef std::pair<OSSUserInfo*, int> 	ShardLease;		//!< User and shard of a lease
+
+	class LeaseManager
+	{
+		public:
+			static int Start(const char *pInstanceId, const char *pLeaseDir);
+			static void Stop();
+			static const char* GetInstanceId();
+
+			static void Register(OSSUserInfo *pUser, int pShardCount);
+			static void Unregister(OSSUserInfo *pUser);
+			static bool IsOwned(OSSUserInfo *pUser, int pShard);
+			static bool IsLastInstance();
+			static unsigned int HashInstanceId(const char *pInstanceId);
+			static bool IsLiveInstance(unsigned int pHash);
+
+		private:
+			static void* leaseThread(void *pArg);
+			static void balance();
+			static int getLiveInstances();
+			static bool isLive(const char *pInstanceId);
+			static bool readOwner(const ShardLease &pLease, char *pOwner, int pLen);
+			static bool acquire(const ShardLease &pLease);
+			static void release(const ShardLease &pLease);
+			static void leaseFileName(const ShardLease &pLease, char *pFileName, int pLen);
+			static void wakeThreads(const ShardLease &pLease);
+
+			static pthread_mutex_t 				_mutex;				//!< Protects the leases
+			static pthread_mutex_t 				_roundMutex;		//!< Makes sure only one balance round runs at a time
+			static bool 						_isStopped;			//!< Set once the leases are given up at shut down
+			static char 						_instanceId[128];	//!< Name of this instance, empty when leases are not used
+			static char 						_leaseDir[1024];	//!< Directory holding the instance and lease files
+			static char 						_instanceFile[1200];	//!< File touched to show that this instance is live
+			static int 							_renewInterval;		//!< Seconds between the balance rounds
+			static int 							_timeout;			//!< Seconds after which a silent instance is taken as gone
+			static std::map<OSSUserInfo*, int> 	_users;				//!< Shard count of the registered users
+			static std::set<ShardLease> 		_owned;				//!< Leases held by this instance
+	};
+}
+
+#endif
@@ -9,8 +9,16 @@
 
 #include <string.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <XMLIAClient.h>
 #include <SessionLayer.h>
+#include <SessionConfig.h>
+#include <FlightRecorder.h>
+#include <TrafficCapture.h>
+#include <SnapshotSession.h>
+#include <LeaseManager.h>
 
 using namespace std;
 using namespace SPS;
@@ -21,25 +29,22 @@ XMLIAClientVector 		XMLIAClient::xmliaClientVec;	//!< Forward Declaration of sta
 char 				GProcessStopCheckFileName[1024];	//!< Global variable which holds the filename which indicates successful stop of SessionLayerobj.
 char 				GSessionStopfileName[1024];			//!< Global variable which holds the stop file name required to stop the SessionLayer.
 char				GLogFileName[1024];                 //!< Global variable used to store the Log File Name.
+char				GFlightFileName[1024];              //!< Global variable used to store the flight recorder dump file name.
 
 ABL_Logger          		gABLLoggerObj;                      //!< Global ABL Logger Object for logging
+volatile sig_atomic_t 		GStopSignal = 0;					//!< Signal which stopped the Session Layer, set by the signal handler
 
 	
 extern "C"
 {
 	/**
-	 * @fn sigint_handler
+	 * @fn logStopSignal
 	 * @param Integer indicating the type of the signal
-	 * @brief This will be invoked when any signals are captured. 
-	 *
-	 *	The task of this function is to create the stop signal for the graceful shut down of the SessionLayer. When any signals are captured, this function 
-	 *	create the touch file required to stop the SessionLayer. Upon successfull completion of the task by the SessionLayer, it offers a smooth shut down.
+	 * @brief Logs the signal which stopped the Session Layer. Invoked from the main path once the Session Layer has stopped, and from
+	 *	the signal handler only on a fault or an abort, after which the process cannot continue
 	 */
-	void sigint_handler(int sig)
+	static void logStopSignal(int sig)
 	{
-		char 		lTouchCmd[2048];	//!< Used to hold the touch command used to create the stop file
-		struct stat stFileInfo;			//!< Structure used to hold the status of a file used with the stat function.
-
 		//! Checking the type of the signal
 		switch (sig)
     	{
@@ -63,30 +68,62 @@ extern "C"
 				gABLLoggerObj<<CRITICAL<<"Stop signal received due to connection error with SPS"<<Endl;
 				break;
     	}
+	}//static void logStopSignal(int sig)
 
-		//! Preparing the touch command used to create a touch file in the SESSION_HOME_PATH directory. The name of the stop file is passed as an argument to 		 //! to the Main and its copied to the GSessionStopfileName variable.
-		strcpy(lTouchCmd, "touch ");
-		strcat(lTouchCmd, GSessionStopfileName);
 
-		//! Executing the system function to create the touch file
-		system(lTouchCmd);
 
-		//! Entering the lop for checking the existence of the process stop check touch file. When the stop signals are received by the Session Layer,
-		//! Session Layer closes all the TCP connections with the SPS. Once all the connections are closed, Session Layer indicates the successfull shut down		 //! to the Main through the  process stop check touch file
-		while( 0 != stat(GProcessStopCheckFileName, &stFileInfo))
+	/**
+	 * @fn sigint_handler
+	 * @param Integer indicating the type of the signal
+	 * @brief This will be invoked when any signals are captured. 
+	 *
+	 *	The task of this function is to create the stop signal for the graceful shut down of the SessionLayer. When any signals are captured, this function 
+	 *	create the touch file required to stop the SessionLayer and returns. The main path closes the capture file and gives up the leases once the
+	 *	SessionLayer has stopped, so the handler takes no lock which the interrupted thread may hold.
+	 */
+	void sigint_handler(int sig)
+	{
+		struct stat stFileInfo;			//!< Structure used to hold the status of a file used with the stat function.
+		int 		lFd;				//!< Descriptor of the stop file
+
+		GStopSignal = sig;
+
+		//! Creating the stop file in the SESSION_HOME_PATH directory. The name of the stop file is passed as an argument to the Main and its copied
+		//! to the GSessionStopfileName variable. open is used instead of system, as it is safe to call from a signal handler
+		lFd = open(GSessionStopfileName, O_WRONLY | O_CREAT, 0644);
+		if (0 <= lFd)
 		{
-			//! Sleep and continue untill. the notification arrives from the Session Layer
-			sleep(1);
+			close(lFd);
 		}
 
-		//! Removing the  process stop check touch file after successfull stopping of the Session Layer
-		remove(GProcessStopCheckFileName);
-		gABLLoggerObj<<INFO<<"Removed the Stop Signal File"<<Endl;
-		gABLLoggerObj<<INFO<<"Log File Closed"<<Endl;
-        	gABLLoggerObj<<INFO<<"****************************************"<<Endl;
-
-		exit(0);
+		//! After a fault or an abort the interrupted thread cannot continue. The handler waits till the Session Layer indicates the successfull shut down
+		//! through the process stop check touch file and exits without closing the capture file
+		if (SIGSEGV == sig || SIGABRT == sig)
+		{
+			logStopSignal(sig);
+			while( 0 != stat(GProcessStopCheckFileName, &stFileInfo))
+			{
+				//! Sleep and continue untill. the notification arrives from the Session Layer
+				sleep(1);
+			}
+			remove(GProcessStopCheckFileName);
+			_exit(0);
+		}
 	}//void sigint_handler(int sig)
+
+
+
+	/**
+	 * @fn flight_dump_handler
+	 * @param Integer indicating the type of the signal
+	 * @brief Invoked on SIGUSR2 to write the stage timestamps of all the XMLIAClient threads to the flight recorder dump file.
+	 *
+	 *	The process continues to run after the dump. Tools/FlightTrace converts the dump to the Chrome trace format.
+	 */
+	void flight_dump_handler(int sig)
+	{
+		FlightRecorder::Dump(GFlightFileName);
+	}//void flight_dump_handler(int sig)
 }
 
 
@@ -101,6 +138,11 @@ int main(int argc, char* argv[])
 {
 	char 	*lTemp;				//! Character pointer which stores the Session Layer Home path retrieved from the env variable
 	char 	lDBConfFile[1024];	//! Used to store the Db configuration file name.
+	char 	lSessionConfFile[1024];	//! Used to store the Session Layer configuration file name.
+	char 	lSnapshotFile[1024];	//! Used to store the configuration snapshot file name.
+	char 	*lInstance;			//! Name of this instance when several instances share the queues, NULL when only one is run
+	char 	lLeaseDir[1024];	//! Used to store the lease directory name.
+	bool 	lIsStartRequired = true;	//! Set to false when the Session Layer was stopped while running from the snapshot
 	int 	lReturn;			//!< Used to hold the return values during function calls.
 	char 	lLogMsgBuf[512];		//!< Logger Message Buffer
 	
@@ -129,17 +171,76 @@ int main(int argc, char* argv[])
 	strcat(GProcessStopCheckFileName, "/");
 	strcpy(GSessionStopfileName, GProcessStopCheckFileName);
 	
+	//! When several instances are run, the name of the instance set in SESSION_LAYER_INSTANCE by startsession is added to the log file
+	//! and the stop indicator file names, so that each instance has its own control files
+	lInstance = getenv("SESSION_LAYER_INSTANCE");
+	if (NULL != lInstance && '\0' == *lInstance)
+	{
+		lInstance = NULL;
+	}
+
 	strcpy(GLogFileName, lTemp);
     	strcat(GLogFileName, "/Logs/SessionLog");
+	if (NULL != lInstance)
+	{
+		strcat(GLogFileName, ".");
+		strcat(GLogFileName, lInstance);
+	}
 	std::cout << "Log file name : " << GLogFileName << std::endl;
 	
 	gABLLoggerObj.mb_initLogger(GLogFileName, 0, "TAR", LOG_FILE_SIZE, LOG_FILE_SEQUENCE, true);
 	gABLLoggerObj<<INFO<<"Log File Opened Successfully"<<Endl;
 	gABLLoggerObj<<INFO<<"----------------------------"<<Endl;
 
+	//! Loading the tunables of the Session Layer. The file is optional and the defaults are used for the keys which are not configured
+	strcpy(lSessionConfFile, lTemp);
+	strcat(lSessionConfFile, "/Conf/session.conf");
+	lReturn = SessionConfig::Load(lSessionConfFile);
+	memset(lLogMsgBuf, '\0', sizeof(lLogMsgBuf));
+	sprintf(lLogMsgBuf, "Session Configuration File : %s | Keys Loaded : %d", lSessionConfFile, lReturn);
+	gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+
+	//! Starting the flight recorder. The dump file is created in the Logs directory on SIGUSR2
+	FlightRecorder::Init(SessionConfig::GetInt("FlightRecorderEvents", 4096));
+	sprintf(GFlightFileName, "%s/Logs/FlightRecorder.%d.bin", lTemp, (int) getpid());
+
+	//! Starting the traffic capture if a capture file is configured
+	if ('\0' != *SessionConfig::GetString("CaptureFile", ""))
+	{
+		lReturn = TrafficCapture::Open(SessionConfig::GetString("CaptureFile", ""), SessionConfig::GetInt("CaptureBufferKB", 1024));
+		memset(lLogMsgBuf, '\0', sizeof(lLogMsgBuf));
+		sprintf(lLogMsgBuf, "Traffic Capture File : %s | %s", SessionConfig::GetString("CaptureFile", ""), (0 == lReturn) ? "Opened" : "Unable to Open");
+		gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+	}
+
 	//! The GProcessStopCheckFileName file will be created by the Session Layer once it is exiting. 
 	//! This is required by the signal handler process to wait untill Session Layer completes its task.
 	strcat(GProcessStopCheckFileName, "SessStoppedIndi");
+	if (NULL != lInstance)
+	{
+		strcat(GProcessStopCheckFileName, ".");
+		strcat(GProcessStopCheckFileName, lInstance);
+
+		//! Joining the other instances. The shards of the users are split between the instances through the leases in the lease
+		//! directory, which defaults to Leases/<host name> as the Message Queues are local to the host
+		gethostname(lLogMsgBuf, 256);
+		lLogMsgBuf[255] = '\0';
+		snprintf(lLeaseDir, sizeof(lLeaseDir), "%s/Leases/%s", lTemp, lLogMsgBuf);
+		if ('\0' != *SessionConfig::GetString("LeaseDir", ""))
+		{
+			strncpy(lLeaseDir, SessionConfig::GetString("LeaseDir", ""), sizeof(lLeaseDir) - 1);
+		}
+		if (0 != LeaseManager::Start(lInstance, lLeaseDir))
+		{
+			memset(lLogMsgBuf, '\0', sizeof(lLogMsgBuf));
+			sprintf(lLogMsgBuf, "Unable to Join as Instance : %s | Lease Directory : %s | Another instance with the same name may be running", lInstance, lLeaseDir);
+			gABLLoggerObj<<_ERROR<<lLogMsgBuf<<Endl;
+			return -1;
+		}
+		memset(lLogMsgBuf, '\0', sizeof(lLogMsgBuf));
+		sprintf(lLogMsgBuf, "Instance : %s | Lease Directory : %s", lInstance, lLeaseDir);
+		gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+	}
 	
 	strcat(GSessionStopfileName, argv[1]);
 
@@ -174,6 +275,11 @@ int main(int argc, char* argv[])
         std::cout << "SIG ALRM not set" << std::endl;
         return -1;
     }
+    if (signal(SIGUSR2, flight_dump_handler) == SIG_ERR)
+    {
+        std::cout << "SIGUSR2 not set" << std::endl;
+        return -1;
+    }
 	
 	//! Creating the object of SessionLayer. Arguments passed are <stop file name>, <service layer indicator file name> and <home path>
 	SessionLayer lSesLayerObj(argv[1], lTemp);
@@ -186,6 +292,10 @@ int main(int argc, char* argv[])
 	sprintf(lLogMsgBuf, "Configuration File : %s", lDBConfFile);
 	gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
 
+	//! The configuration snapshot is written after every successful load from the database and used when the database is not reachable
+	strcpy(lSnapshotFile, lTemp);
+	strcat(lSnapshotFile, "/Conf/config.snap");
+
 	//! Establishing connection to the database.	
 	try
 	{	
@@ -193,32 +303,59 @@ int main(int argc, char* argv[])
 	}
 	catch(ABL_Exception)
 	{
-		gABLLoggerObj<<INFO<<"Unable to establish connection to the Database: Please check the db.conf file in the Conf Directory"<<Endl;
-		gABLLoggerObj<<INFO<<"Log File Closed"<<Endl;
-		gABLLoggerObj<<INFO<<"****************************************"<<Endl;
-		return -1;
+		lReturn = -1;
 	}
 	if (0 != lReturn)
 	{
 		gABLLoggerObj<<INFO<<"Unable to establish connection to the Database: Please check the db.conf file in the Conf Directory"<<Endl;
-		gABLLoggerObj<<INFO<<"Log File Closed"<<Endl;
-		gABLLoggerObj<<INFO<<"****************************************"<<Endl;
-		return -1;
+
+		//! Coming up from the configuration snapshot. The database connection is retried in the background and the SessionLayer takes
+		//! over once it succeeds.
+		ConfigSnapshot 	lSnapshot;
+		SnapshotSession lSnapshotSession(GSessionStopfileName, GProcessStopCheckFileName);
+
+		if (0 != lSnapshot.Open(lSnapshotFile) || 0 != lSnapshotSession.Start(lSnapshot))
+		{
+			gABLLoggerObj<<INFO<<"No valid Configuration Snapshot present to start without the Database"<<Endl;
+			gABLLoggerObj<<INFO<<"Log File Closed"<<Endl;
+			gABLLoggerObj<<INFO<<"****************************************"<<Endl;
+			return -1;
+		}
+
+		memset(lLogMsgBuf, '\0', sizeof(lLogMsgBuf));
+		sprintf(lLogMsgBuf, "Started from the Configuration Snapshot : %s | Users : %d | Servers : %d | Written at : %lld", lSnapshotFile, lSnapshot.GetUserCount(), lSnapshot.GetServerCount(), lSnapshot.GetCreatedTime());
+		gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+		lSnapshot.Close();
+
+		lIsStartRequired = (1 == lSnapshotSession.Run(lSesLayerObj, lDBConfFile));
 	}
 
-	//! Calling the Start process of the SessionLayer
-	gABLLoggerObj<<DEBUG<<"Starting the Session Layer"<<Endl;
-	lReturn = lSesLayerObj.Start();
-	
-	if (0 == lReturn)
+	if (lIsStartRequired)
 	{
-		//! Waiting for the SessionLayer thread to exit
-		pthread_join(lSesLayerObj.threadID, NULL);
+		//! Calling the Start process of the SessionLayer
+		gABLLoggerObj<<DEBUG<<"Starting the Session Layer"<<Endl;
+		lReturn = lSesLayerObj.Start();
+	
+		if (0 == lReturn)
+		{
+			//! Refreshing the configuration snapshot once the SessionLayer has loaded the users, and periodically after that
+			SnapshotSession::ScheduleSave(lSnapshotFile, SessionConfig::GetInt("SnapshotSettleSec", 10), SessionConfig::GetInt("SnapshotSaveIntervalSec", 3600));
+
+			//! Waiting for the SessionLayer thread to exit
+			pthread_join(lSesLayerObj.threadID, NULL);
+		}
 	}
 	
+	if (0 != GStopSignal)
+	{
+		logStopSignal(GStopSignal);
+	}
+
 	//! Removing the Process Stop Checking File which will be created by the SessionLayer during exit
 	remove(GProcessStopCheckFileName);
 	gABLLoggerObj<<INFO<<"Removed the Stop Signal File"<<Endl;
+	LeaseManager::Stop();
+	TrafficCapture::Close();
 	gABLLoggerObj<<INFO<<"Log File Closed"<<Endl;
         gABLLoggerObj<<INFO<<"****************************************"<<Endl;
 	return 0;
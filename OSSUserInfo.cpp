@@ -7,6 +7,10 @@
 
 #include <OSSUserInfo.h>
 #include <XMLIAClient.h>
+#include <QueueShards.h>
+#include <LeaseManager.h>
+#include <ShutdownDrain.h>
+#include <ThreadPlacement.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <sys/stat.h>
@@ -45,6 +49,16 @@ int OSSUserInfo::CreateQueues()
 		gABLLoggerObj<<_ERROR<<_logMsgBuf<<Endl;
 		return -1;
 	}
+
+	//! Getting the Request and Response Message Queues of the remaining shards, if the user is configured with more than one
+	if (0 != QueueShards::Create(this))
+	{
+		memset(_logMsgBuf, '\0', sizeof(_logMsgBuf));
+		sprintf(_logMsgBuf, "Unable to Create the Message Queue Shards for User : %s ", userName );
+		gABLLoggerObj<<_ERROR<<_logMsgBuf<<Endl;
+		return -1;
+	}
+	return 0;
 }//int OSSUserInfo::CreateQueues()
 
 
@@ -103,7 +117,10 @@ void OSSUserInfo::DecrementConnectionCount()
 		strcpy(ltouchStopCmd, "touch ");
 		strcat(ltouchStopCmd, _stopFileName);
 		system(ltouchStopCmd);
-		remove(touchFileName);
+		if (LeaseManager::IsLastInstance())
+		{
+			remove(touchFileName);
+		}
 	}
 
 
@@ -140,11 +157,18 @@ void OSSUserInfo::IncrementConnectionCount()
 bool OSSUserInfo::StopUserConnections()
 {
 	int lIndex;		//!< Local index used in loops
+	int lShard;		//!< Local index used in loops over the queue shards
+	bool lIsDraining;	//!< Set when the connections are stopped by the drain thread
 
 	MsqQueStruct lMsgQueStrObj;	//!< Message Queue object to send the stop messages
 	
-	remove(touchFileName);	
-	lMsgQueStrObj.mType = 123123;	//!< Setting the mType of the request to 123123, hardcoded and understood by the XMLIAClient
+	//! The touch file is shared by the instances serving the user, it is left in place while another instance is live
+	if (LeaseManager::IsLastInstance())
+	{
+		remove(touchFileName);
+	}
+	memset(&lMsgQueStrObj, '\0', sizeof(lMsgQueStrObj));
+	lMsgQueStrObj.mType = QueueShards::GetStopMType(this);	//!< Setting the mType of the request to the one named after this instance and user object, understood by its XMLIAClient threads
 	_isStopSigReceived = true;
     strcpy(lMsgQueStrObj.xmlRequest, "STOP");
 
@@ -155,13 +179,21 @@ bool OSSUserInfo::StopUserConnections()
         sprintf(_logMsgBuf, "Current Number of Connections for User : %s is %d", userName,_currentConnCount );
         gABLLoggerObj<<INFO<<_logMsgBuf<<Endl;
 
-	//! Sending the stop messages to those many active connections
-	if (0 != _currentConnCount )
+	//! With ShutdownDeadlineMs set, the intake stops now and the drain thread answers the queued requests before sending the stop
+	//! messages, and releases the stop now semaphore once the threads are gone
+	lIsDraining = ShutdownDrain::Begin(this, lMsgQueStrObj);
+
+	//! Sending the stop messages to those many active connections. Each thread gets its stop message in the Request Message Queue of
+	//! the shard it is tied to. The threads waiting for this instance to hold a shard see the _isStopSignalReceived flag set below
+	if (!lIsDraining && 0 != _currentConnCount )
     	{
-		for (lIndex = 0; lIndex < _currentConnCount ; lIndex++)
-    		{
-        		msgsnd(_requestMsgQueueId, &lMsgQueStrObj, sizeof(lMsgQueStrObj), 0);
-    		}
+		for (lShard = 0; lShard < QueueShards::GetShardCount(this); lShard++)
+		{
+			for (lIndex = 0; lIndex < QueueShards::GetThreadCount(this, lShard); lIndex++)
+			{
+				msgsnd(QueueShards::GetRequestQueueId(this, lShard), &lMsgQueStrObj, sizeof(lMsgQueStrObj.xmlRequest), 0);
+			}
+		}
 	}
 	for (lIndex = 0; lIndex < XMLIAClient::xmliaClientVec.size(); lIndex++)
     	{
@@ -179,7 +211,10 @@ bool OSSUserInfo::StopUserConnections()
         gABLLoggerObj<<INFO<<"Stop Signals send to XMLIA Clients"<<Endl;
 
 	//! Releasing the stop now semaphore
-    stopNowSemaphore.mb_release();
+	if (!lIsDraining)
+	{
+    	stopNowSemaphore.mb_release();
+	}
 }//bool OSSUserInfo::StopUserConnections()
 
 
@@ -220,6 +255,9 @@ int OSSUserInfo::CreateSPSConnections()
 		sleep (1);
 	}
 
+	//! The configuration snapshot is written only once every user got this far
+	QueueShards::MarkStarted(this);
+
 	//! If there is not even a single active connection for the user, return a failure to the calling fucntion
 	if (!(this->isConnected))
 	{
@@ -251,11 +289,24 @@ OSSUserInfo::OSSUserInfo(char *pStopFile)
 /**
  * @fn ~OSSUserInfo
  * @param Nil
- * @brief Destructor of the OSSUserInfo. Once destructor is invoked, the request and response message queues will be removed from the server
+ * @brief Destructor of the OSSUserInfo. Once destructor is invoked, the request and response message queues will be removed from the server,
+		unless another instance still serves them
  */
 OSSUserInfo::~OSSUserInfo()
 {
-	msgctl(_requestMsgQueueId, IPC_RMID, NULL);
-	msgctl(_responseMsgQueueId, IPC_RMID, NULL);
+	//! The queues are shared by all the instances, so they are kept while another instance still serves them. The queues of a
+	//! snapshot user are taken over by the user loaded from the database and are kept as well
+	if (!LeaseManager::IsLastInstance())
+	{
+		QueueShards::HandOver(this);
+	}
+	if (!QueueShards::IsHandedOver(this))
+	{
+		msgctl(_requestMsgQueueId, IPC_RMID, NULL);
+		msgctl(_responseMsgQueueId, IPC_RMID, NULL);
+	}
+	QueueShards::Remove(this);
+	ShutdownDrain::RemoveUser(this);
+	ThreadPlacement::RemoveUser(this);
 }//OSSUserInfo::~OSSUserInfo()
 
@@ -0,0 +1,526 @@
+/**
+    @file QueueShards.cpp
+    @brief This file contains the definition for all the member functions of the QueueShards class
+
+*/
+
+#include <QueueShards.h>
+#include <SessionConfig.h>
+#include <LeaseManager.h>
+#include <errno.h>
+
+using namespace SPS;
+
+extern ABL_Logger gABLLoggerObj;    //!< Global ABL Logger Object for logging
+
+pthread_mutex_t 					QueueShards::_mutex = PTHREAD_MUTEX_INITIALIZER;
+long 								QueueShards::_stopGeneration = 0;
+std::map<OSSUserInfo*, UserShards> 	QueueShards::_users;
+std::map<XMLIAClient*, int> 		QueueShards::_clientShard;
+
+
+
+/**
+ * @fn find
+ * @param User
+ * @ret returns the shards of the user, NULL if Create was not invoked for the user. Should be invoked with the mutex held
+ */
+UserShards* QueueShards::find(OSSUserInfo *pUser)
+{
+	std::map<OSSUserInfo*, UserShards>::iterator 	lIter = _users.find(pUser);
+
+	return (lIter == _users.end()) ? NULL : &lIter->second;
+}
+
+
+
+/**
+ * @fn Create
+ * @param User whose queues are created
+ * @ret returns 0 on success and -1 on failure
+ * @brief Gets or creates the Request and Response Message Queues of all the shards of the user. Invoked from OSSUserInfo::CreateQueues
+ */
+int QueueShards::Create(OSSUserInfo *pUser)
+{
+	UserShards 	lShards;		//!< Queues of the user
+	char 		lKey[256];		//!< Configuration key of the shard count of the user
+	char 		lLogMsgBuf[512];	//!< Logger Message Buffer
+	int 		lShardCount;	//!< Number of shards of the user
+	int 		lStride;		//!< Distance between the keys of two shards
+	int 		lIndex;			//!< Used as index in loops
+
+	snprintf(lKey, sizeof(lKey), "QueueShards.%s", pUser->userName);
+	lShardCount = SessionConfig::GetInt(lKey, SessionConfig::GetInt("QueueShards", 1));
+	lShardCount = (lShardCount < 1) ? 1 : lShardCount;
+
+	//! Each thread reads a single shard, so the shards above the connection count of the user would never be read
+	if (pUser->maxConnection < lShardCount)
+	{
+		snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Queue Shards Above Max Connections for User : %s | Shards : %d | Max Connections : %d | Using %d Shards", pUser->userName, lShardCount, pUser->maxConnection, (pUser->maxConnection < 1) ? 1 : pUser->maxConnection);
+		gABLLoggerObj<<_ERROR<<lLogMsgBuf<<Endl;
+		lShardCount = (pUser->maxConnection < 1) ? 1 : pUser->maxConnection;
+	}
+	lStride = SessionConfig::GetInt("QueueShardKeyStride", 0x10000);
+
+	for (lIndex = 0; lIndex < lShardCount; lIndex++)
+	{
+		lShards.requestQueueIds.push_back(msgget(pUser->requestQueueKey + lIndex * lStride, 0666 | IPC_CREAT));
+		lShards.responseQueueIds.push_back(msgget(pUser->responseQueueKey + lIndex * lStride, 0666 | IPC_CREAT));
+		lShards.threadCount.push_back(0);
+
+		if (lShards.requestQueueIds[lIndex] < 0 || lShards.responseQueueIds[lIndex] < 0)
+		{
+			return -1;
+		}
+	}
+
+	//! The stop messages are named after this instance and the user object, so that a thread never stops on the stop message of
+	//! another instance reading the same queue, or of the threads being replaced on the hand over from the snapshot users
+	pthread_mutex_lock(&_mutex);
+	lShards.stopMType = STOP_MTYPE_BASE + ((long) LeaseManager::HashInstanceId(LeaseManager::GetInstanceId()) << 16) + (_stopGeneration++ & 0xFFFF);
+	lShards.isHandedOver = false;
+	lShards.isStarted = false;
+	_users[pUser] = lShards;
+	pthread_mutex_unlock(&_mutex);
+
+	LeaseManager::Register(pUser, lShardCount);
+	return 0;
+}//int QueueShards::Create(OSSUserInfo *pUser)
+
+
+
+/**
+ * @fn Remove
+ * @param User whose queues are removed
+ * @ret void
+ * @brief Removes the queues of the shards other than shard 0, which is removed by the OSSUserInfo destructor. The queues handed over
+		to another user object, or to the other instances while one is live, are kept, without the stop messages left for the threads
+		of this user object which had already exited
+ */
+void QueueShards::Remove(OSSUserInfo *pUser)
+{
+	UserShards 	*lpShards;		//!< Queues of the user
+	int 		lIndex;			//!< Used as index in loops
+
+	LeaseManager::Unregister(pUser);
+
+	pthread_mutex_lock(&_mutex);
+	lpShards = find(pUser);
+	if (NULL != lpShards && lpShards->isHandedOver)
+	{
+		purgeStops(*lpShards);
+	}
+	for (lIndex = 1; NULL != lpShards && !lpShards->isHandedOver && lIndex < lpShards->requestQueueIds.size(); lIndex++)
+	{
+		msgctl(lpShards->requestQueueIds[lIndex], IPC_RMID, NULL);
+		msgctl(lpShards->responseQueueIds[lIndex], IPC_RMID, NULL);
+	}
+	_users.erase(pUser);
+	pthread_mutex_unlock(&_mutex);
+}//void QueueShards::Remove(OSSUserInfo *pUser)
+
+
+
+/**
+ * @fn purgeStops
+ * @param Queues of a user object being removed
+ * @ret void
+ * @brief Takes the stop messages of the user object out of all its Request Message Queues. Should be invoked with the mutex held
+ */
+void QueueShards::purgeStops(const UserShards &pShards)
+{
+	MsqQueStruct 	lMsg;		//!< Stop message taken out
+	int 			lIndex;		//!< Used as index in loops
+
+	for (lIndex = 0; lIndex < pShards.requestQueueIds.size(); lIndex++)
+	{
+		while (0 <= msgrcv(pShards.requestQueueIds[lIndex], &lMsg, sizeof(lMsg.xmlRequest), pShards.stopMType, IPC_NOWAIT | MSG_NOERROR))
+		{
+		}
+	}
+}
+
+
+
+/**
+ * @fn HandOver
+ * @param User whose queues are taken over by another user object of the same name
+ * @ret void
+ * @brief Keeps the queues when the user object is deleted, so that the requests queued for it are served by the new user object
+ */
+void QueueShards::HandOver(OSSUserInfo *pUser)
+{
+	UserShards 	*lpShards;
+
+	pthread_mutex_lock(&_mutex);
+	lpShards = find(pUser);
+	if (NULL != lpShards)
+	{
+		lpShards->isHandedOver = true;
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+
+
+/**
+ * @fn IsHandedOver
+ * @param User
+ * @ret returns true if the queues of the user are taken over by another user object and should not be removed
+ */
+bool QueueShards::IsHandedOver(OSSUserInfo *pUser)
+{
+	UserShards 	*lpShards;
+	bool 		lIsHandedOver;
+
+	pthread_mutex_lock(&_mutex);
+	lpShards = find(pUser);
+	lIsHandedOver = (NULL != lpShards && lpShards->isHandedOver);
+	pthread_mutex_unlock(&_mutex);
+	return lIsHandedOver;
+}
+
+
+
+/**
+ * @fn ForEachUser
+ * @param Function invoked for each user
+ * @param Argument passed on to the function
+ * @ret void
+ * @brief Invokes the function for every user whose queues are created. The mutex is held meanwhile, so that no user is deleted under
+		the function, which should not call back into QueueShards
+ */
+void QueueShards::ForEachUser(void (*pFunc)(OSSUserInfo*, void*), void *pArg)
+{
+	std::map<OSSUserInfo*, UserShards>::iterator 	lIter;
+
+	pthread_mutex_lock(&_mutex);
+	for (lIter = _users.begin(); lIter != _users.end(); lIter++)
+	{
+		pFunc(lIter->first, pArg);
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+
+
+/**
+ * @fn MarkStarted
+ * @param User whose SPS connections were all attempted
+ * @ret void
+ * @brief Invoked from OSSUserInfo::CreateSPSConnections, whether or not the connections came up
+ */
+void QueueShards::MarkStarted(OSSUserInfo *pUser)
+{
+	UserShards 	*lpShards;
+
+	pthread_mutex_lock(&_mutex);
+	lpShards = find(pUser);
+	if (NULL != lpShards)
+	{
+		lpShards->isStarted = true;
+	}
+	pthread_mutex_unlock(&_mutex);
+}
+
+
+
+/**
+ * @fn IsAllStarted
+ * @param Set to the number of users whose queues are created
+ * @ret returns true if there is at least one user and the SPS connections of every user were attempted
+ */
+bool QueueShards::IsAllStarted(int &pUserCount)
+{
+	std::map<OSSUserInfo*, UserShards>::iterator 	lIter;
+	bool 	lIsAllStarted = true;
+
+	pthread_mutex_lock(&_mutex);
+	for (lIter = _users.begin(); lIter != _users.end(); lIter++)
+	{
+		lIsAllStarted = lIsAllStarted && lIter->second.isStarted;
+	}
+	pUserCount = _users.size();
+	pthread_mutex_unlock(&_mutex);
+	return (0 < pUserCount && lIsAllStarted);
+}
+
+
+
+/**
+ * @fn GetShardCount
+ * @param User
+ * @ret returns the number of shards of the user
+ */
+int QueueShards::GetShardCount(OSSUserInfo *pUser)
+{
+	UserShards 	*lpShards;
+	int 		lCount;
+
+	pthread_mutex_lock(&_mutex);
+	lpShards = find(pUser);
+	lCount = (NULL == lpShards) ? 1 : lpShards->requestQueueIds.size();
+	pthread_mutex_unlock(&_mutex);
+	return lCount;
+}
+
+
+
+/**
+ * @fn Attach
+ * @param User of the XMLIAClient
+ * @param XMLIAClient whose thread is starting
+ * @ret returns the shard to which the thread is tied, -1 if this instance holds none of the shards of the user
+ * @brief Ties the thread to the shard having the least number of threads among the shards held by this instance, so that every shard
+		is served
+ */
+int QueueShards::Attach(OSSUserInfo *pUser, XMLIAClient *pClient)
+{
+	UserShards 	*lpShards;		//!< Queues of the user
+	int 		lShard = -1;	//!< Shard with the least number of threads
+	int 		lIndex;			//!< Used as index in loops
+
+	pthread_mutex_lock(&_mutex);
+	lpShards = find(pUser);
+	if (NULL == lpShards)
+	{
+		lShard = 0;
+	}
+	for (lIndex = 0; NULL != lpShards && lIndex < lpShards->threadCount.size(); lIndex++)
+	{
+		if (LeaseManager::IsOwned(pUser, lIndex) && (lShard < 0 || lpShards->threadCount[lIndex] < lpShards->threadCount[lShard]))
+		{
+			lShard = lIndex;
+		}
+	}
+	if (NULL != lpShards && 0 <= lShard)
+	{
+		lpShards->threadCount[lShard]++;
+	}
+	_clientShard[pClient] = lShard;
+	pthread_mutex_unlock(&_mutex);
+	return lShard;
+}//int QueueShards::Attach(OSSUserInfo *pUser, XMLIAClient *pClient)
+
+
+
+/**
+ * @fn Detach
+ * @param User of the XMLIAClient
+ * @param XMLIAClient whose thread is exiting
+ * @ret void
+ */
+void QueueShards::Detach(OSSUserInfo *pUser, XMLIAClient *pClient)
+{
+	std::map<XMLIAClient*, int>::iterator 	lIter;
+	UserShards 								*lpShards;
+
+	pthread_mutex_lock(&_mutex);
+	lIter = _clientShard.find(pClient);
+	lpShards = find(pUser);
+	if (lIter != _clientShard.end())
+	{
+		if (NULL != lpShards && 0 <= lIter->second && 0 < lpShards->threadCount[lIter->second])
+		{
+			lpShards->threadCount[lIter->second]--;
+		}
+		_clientShard.erase(lIter);
+	}
+	pthread_mutex_unlock(&_mutex);
+}//void QueueShards::Detach(OSSUserInfo *pUser, XMLIAClient *pClient)
+
+
+
+/**
+ * @fn GetShard
+ * @param XMLIAClient
+ * @ret returns the shard to which the thread of the XMLIAClient is tied, -1 if it is waiting for this instance to hold a shard
+ */
+int QueueShards::GetShard(XMLIAClient *pClient)
+{
+	std::map<XMLIAClient*, int>::iterator 	lIter;
+	int 									lShard;
+
+	pthread_mutex_lock(&_mutex);
+	lIter = _clientShard.find(pClient);
+	lShard = (lIter == _clientShard.end()) ? -1 : lIter->second;
+	pthread_mutex_unlock(&_mutex);
+	return lShard;
+}
+
+
+
+/**
+ * @fn GetThreadCount
+ * @param User
+ * @param Shard
+ * @ret returns the number of XMLIAClient threads tied to the shard
+ */
+int QueueShards::GetThreadCount(OSSUserInfo *pUser, int pShard)
+{
+	UserShards 	*lpShards;
+	int 		lCount;
+
+	pthread_mutex_lock(&_mutex);
+	lpShards = find(pUser);
+	lCount = (NULL == lpShards || pShard >= lpShards->threadCount.size()) ? 0 : lpShards->threadCount[pShard];
+	pthread_mutex_unlock(&_mutex);
+	return lCount;
+}
+
+
+
+/**
+ * @fn GetMessage
+ * @param User
+ * @param Shard from which the request is read
+ * @param Structure to which the request is read, reused by the caller for every request
+ * @ret returns 0 on success and -1 on failure, where the request is set to "Error" as done by OSSUserInfo::GetMessage
+ * @brief Blocks till a request arrives in the Request Message Queue of the shard. The stop message of the user object is taken first
+		wherever it is in the queue, so a busy thread stops after its current request
+ */
+int QueueShards::GetMessage(OSSUserInfo *pUser, int pShard, MsqQueStruct &pMsg)
+{
+	ssize_t 	lLength;		//!< Length of the request read
+	int 		lQueueId;		//!< Request Message Queue of the shard
+
+	lQueueId = GetRequestQueueId(pUser, pShard);
+
+	//! The control messages are sent with the full size of the request buffer, a longer message is truncated instead of being left at
+	//! the head of the queue. Only the length read is terminated, the rest of the buffer is not cleared
+	lLength = (lQueueId < 0) ? -1 : msgrcv(lQueueId, &pMsg, sizeof(pMsg.xmlRequest), GetStopMType(pUser), IPC_NOWAIT | MSG_NOERROR);
+	while (0 <= lQueueId && lLength < 0)
+	{
+		lLength = msgrcv(lQueueId, &pMsg, sizeof(pMsg.xmlRequest), 0, MSG_NOERROR);
+		if (lLength < 0 && EINTR != errno)
+		{
+			break;
+		}
+	}
+	if (lLength < 0)
+	{
+		pMsg.mType = 0;
+		strcpy(pMsg.xmlRequest, "Error");
+		return -1;
+	}
+	pMsg.xmlRequest[(lLength < sizeof(pMsg.xmlRequest)) ? lLength : sizeof(pMsg.xmlRequest) - 1] = '\0';
+	return 0;
+}//int QueueShards::GetMessage(OSSUserInfo *pUser, int pShard, MsqQueStruct &pMsg)
+
+
+
+/**
+ * @fn GetRequestQueueId
+ * @param User
+ * @param Shard
+ * @ret returns the id of the Request Message Queue of the shard, -1 if not present
+ */
+int QueueShards::GetRequestQueueId(OSSUserInfo *pUser, int pShard)
+{
+	UserShards 	*lpShards;
+	int 		lQueueId;
+
+	pthread_mutex_lock(&_mutex);
+	lpShards = find(pUser);
+	lQueueId = (NULL == lpShards || pShard >= lpShards->requestQueueIds.size()) ? msgget(pUser->requestQueueKey, 0666) : lpShards->requestQueueIds[pShard];
+	pthread_mutex_unlock(&_mutex);
+	return lQueueId;
+}
+
+
+
+/**
+ * @fn GetResponseQueueId
+ * @param User
+ * @param mType of the response
+ * @ret returns the id of the Response Message Queue of the shard mType % N, -1 if not present
+ */
+int QueueShards::GetResponseQueueId(OSSUserInfo *pUser, long pMType)
+{
+	UserShards 	*lpShards;
+	int 		lQueueId;
+
+	pthread_mutex_lock(&_mutex);
+	lpShards = find(pUser);
+	lQueueId = (NULL == lpShards) ? msgget(pUser->responseQueueKey, 0666) : lpShards->responseQueueIds[pMType % lpShards->responseQueueIds.size()];
+	pthread_mutex_unlock(&_mutex);
+	return lQueueId;
+}
+
+
+
+/**
+ * @fn GetQueueDepth
+ * @param User
+ * @ret returns the number of requests waiting in all the Request Message Queues of the user
+ */
+int QueueShards::GetQueueDepth(OSSUserInfo *pUser)
+{
+	struct msqid_ds 	lQueueInfo;		//!< Status of a Request Message Queue
+	int 				lShardCount;	//!< Number of shards of the user
+	int 				lDepth = 0;		//!< Total depth
+	int 				lIndex;			//!< Used as index in loops
+
+	lShardCount = GetShardCount(pUser);
+	for (lIndex = 0; lIndex < lShardCount; lIndex++)
+	{
+		if (0 == msgctl(GetRequestQueueId(pUser, lIndex), IPC_STAT, &lQueueInfo))
+		{
+			lDepth += lQueueInfo.msg_qnum;
+		}
+	}
+	return lDepth;
+}//int QueueShards::GetQueueDepth(OSSUserInfo *pUser)
+
+
+
+/**
+ * @fn GetStopMType
+ * @param User
+ * @ret returns the mType of the stop messages meant for the threads of the user object
+ */
+long QueueShards::GetStopMType(OSSUserInfo *pUser)
+{
+	UserShards 	*lpShards;
+	long 		lMType;
+
+	pthread_mutex_lock(&_mutex);
+	lpShards = find(pUser);
+	lMType = (NULL == lpShards) ? STOP_MTYPE_BASE : lpShards->stopMType;
+	pthread_mutex_unlock(&_mutex);
+	return lMType;
+}
+
+
+
+/**
+ * @fn IsStopMType
+ * @param mType of a message read from a Request Message Queue
+ * @ret returns true if the message is a stop message which still has a reader, that is of a user object of this instance or of another
+		live instance. The stop messages of the removed user objects and of the gone instances are not
+ */
+bool QueueShards::IsStopMType(long pMType)
+{
+	std::map<OSSUserInfo*, UserShards>::iterator 	lIter;
+	bool 	lIsRegistered = false;		//!< Set if the stop message is of a user object of this instance
+	unsigned int 	lHash;				//!< Hash of the name of the instance which sent the stop message
+
+	if (STOP_MTYPE_BASE > pMType)
+	{
+		return false;
+	}
+
+	pthread_mutex_lock(&_mutex);
+	for (lIter = _users.begin(); !lIsRegistered && lIter != _users.end(); lIter++)
+	{
+		lIsRegistered = (pMType == lIter->second.stopMType);
+	}
+	pthread_mutex_unlock(&_mutex);
+
+	lHash = (unsigned int) ((pMType - STOP_MTYPE_BASE) >> 16) & 0x3FFF;
+	if (lIsRegistered || LeaseManager::HashInstanceId(LeaseManager::GetInstanceId()) == lHash)
+	{
+		return lIsRegistered;
+	}
+	return LeaseManager::IsLiveInstance(lHash);
+}//bool QueueShards::IsStopMType(long pMType)
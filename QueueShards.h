@@ -0,0 +1,72 @@
+/**
+    @file QueueShards.h
+    @brief Declaration of the QueueShards class which spreads the requests and responses of a user over several message queues
+
+	A user configured with N shards (QueueShards, or QueueShards.<user name> for a single user) has N Request and N Response Message
+	Queues. Shard 0 uses the requestQueueKey and responseQueueKey of the user and shard i uses the keys plus i * QueueShardKeyStride.
+	The Service Layer pushes a request to the request shard mType % N and waits on the response shard mType % N. Each XMLIAClient
+	thread is tied to one request shard and the response is pushed to the response shard of its mType, so the callers and the threads
+	of a heavy user no more contend on a single queue. With the default of one shard the queues are the same as before. When several
+	instances run, a thread is tied only to the shards its instance holds (see LeaseManager).
+*/
+
+#ifndef _QUEUE_SHARDS_H_
+#define _QUEUE_SHARDS_H_
+
+#include <XMLIAClient.h>
+#include <map>
+#include <vector>
+#include <pthread.h>
+
+#define STOP_MTYPE_BASE 	0x40000000L		//!< The stop messages have an mType of at least this value, above the process ids of the Service Layer
+#define STOP_REQUEUE_WAIT 	10				//!< Time in milliseconds a thread waits after putting back the stop message of another instance
+
+namespace SPS
+{
+	//! Queues of a user and the XMLIAClient threads tied to each of them
+	struct UserShards
+	{
+		std::vector<int> 	requestQueueIds;	//!< Request Message Queue of each shard
+		std::vector<int> 	responseQueueIds;	//!< Response Message Queue of each shard
+		std::vector<int> 	threadCount;		//!< Number of XMLIAClient threads tied to each shard
+		long 				stopMType;			//!< mType of the stop messages meant for the threads of this user object
+		bool 				isHandedOver;		//!< Set when the queues are taken over by another user object and should not be removed
+		bool 				isStarted;			//!< Set once all the SPS connections of the user were attempted
+	};
+
+	class QueueShards
+	{
+		public:
+			static int Create(OSSUserInfo *pUser);
+			static void Remove(OSSUserInfo *pUser);
+			static void HandOver(OSSUserInfo *pUser);
+			static bool IsHandedOver(OSSUserInfo *pUser);
+			static void ForEachUser(void (*pFunc)(OSSUserInfo*, void*), void *pArg);
+			static void MarkStarted(OSSUserInfo *pUser);
+			static bool IsAllStarted(int &pUserCount);
+			static int GetShardCount(OSSUserInfo *pUser);
+
+			static int Attach(OSSUserInfo *pUser, XMLIAClient *pClient);
+			static void Detach(OSSUserInfo *pUser, XMLIAClient *pClient);
+			static int GetShard(XMLIAClient *pClient);
+			static int GetThreadCount(OSSUserInfo *pUser, int pShard);
+
+			static int GetMessage(OSSUserInfo *pUser, int pShard, MsqQueStruct &pMsg);
+			static int GetRequestQueueId(OSSUserInfo *pUser, int pShard);
+			static int GetResponseQueueId(OSSUserInfo *pUser, long pMType);
+			static int GetQueueDepth(OSSUserInfo *pUser);
+			static long GetStopMType(OSSUserInfo *pUser);
+			static bool IsStopMType(long pMType);
+
+		private:
+			static UserShards* find(OSSUserInfo *pUser);
+			static void purgeStops(const UserShards &pShards);
+
+			static pthread_mutex_t 					_mutex;				//!< Protects the maps
+			static long 							_stopGeneration;	//!< Number of user objects created, used to name their stop messages
+			static std::map<OSSUserInfo*, UserShards> 	_users;				//!< Queues of each user
+			static std::map<XMLIAClient*, int> 		_clientShard;		//!< Shard to which each XMLIAClient thread is tied
+	};
+}
+
+#endif
@@ -0,0 +1,159 @@
+/**
+    @file RequestCoalescer.cpp
+    @brief This file contains the definition for all the member functions of the RequestCoalescer class
+
+*/
+
+#include <RequestCoalescer.h>
+#include <SessionConfig.h>
+#include <SessionStats.h>
+#include <string.h>
+
+using namespace SPS;
+
+pthread_mutex_t 							RequestCoalescer::_mutex = PTHREAD_MUTEX_INITIALIZER;
+bool 										RequestCoalescer::_isTypesLoaded = false;
+std::set<std::string> 						RequestCoalescer::_requestTypes;
+std::map<std::string, std::vector<long> > 	RequestCoalescer::_inFlight;
+
+
+
+/**
+ * @fn loadRequestTypes
+ * @param Nil
+ * @ret void
+ * @brief Reads the comma separated root elements of the read only requests from the configuration. Should be invoked with the mutex held
+ */
+void RequestCoalescer::loadRequestTypes()
+{
+	char 	lTypes[1024];	//!< Copy of the configured list
+	char 	*lpType;		//!< Points to each of the types in the list
+	char 	*lpSave;		//!< Used by strtok_r
+
+	if (_isTypesLoaded)
+	{
+		return;
+	}
+
+	memset(lTypes, '\0', sizeof(lTypes));
+	strncpy(lTypes, SessionConfig::GetString("CoalesceRequestTypes", ""), sizeof(lTypes) - 1);
+	for (lpType = strtok_r(lTypes, ", ", &lpSave); NULL != lpType; lpType = strtok_r(NULL, ", ", &lpSave))
+	{
+		_requestTypes.insert(lpType);
+	}
+	_isTypesLoaded = true;
+}//void RequestCoalescer::loadRequestTypes()
+
+
+
+/**
+ * @fn makeKey
+ * @param Name of the user
+ * @param Request to be sent to SPS
+ * @ret returns the key identifying the request in the in flight map
+ */
+std::string RequestCoalescer::makeKey(const char *pUserName, const char *pRequest)
+{
+	std::string lKey(pUserName);	//!< Key made of the user name and the request
+
+	lKey += '\n';
+	lKey += pRequest;
+	return lKey;
+}
+
+
+
+/**
+ * @fn IsCoalescable
+ * @param Request to be sent to SPS
+ * @ret returns true if the root element of the request is one of the configured read only requests
+ */
+bool RequestCoalescer::IsCoalescable(const char *pRequest)
+{
+	const char 	*lpStart;		//!< Start of the root element name
+	size_t 		lLen;			//!< Length of the root element name
+
+	pthread_mutex_lock(&_mutex);
+	loadRequestTypes();
+	pthread_mutex_unlock(&_mutex);
+
+	if (_requestTypes.empty())
+	{
+		return false;
+	}
+
+	//! Skipping the XML declaration and the comments to reach the root element
+	for (lpStart = strchr(pRequest, '<'); NULL != lpStart && ('?' == lpStart[1] || '!' == lpStart[1]); lpStart = strchr(lpStart + 1, '<'))
+	{
+	}
+	if (NULL == lpStart)
+	{
+		return false;
+	}
+
+	lpStart++;
+	lLen = strcspn(lpStart, " \t\r\n/>");
+	return _requestTypes.end() != _requestTypes.find(std::string(lpStart, lLen));
+}//bool RequestCoalescer::IsCoalescable(const char *pRequest)
+
+
+
+/**
+ * @fn Join
+ * @param Name of the user
+ * @param Request to be sent to SPS
+ * @param mType of the request in the Request Message Queue
+ * @ret returns true if an identical request is already in flight and the mType is recorded against it. Returns false if the caller
+		has to send the request to SPS and invoke Finish once the response is pushed.
+ */
+bool RequestCoalescer::Join(const char *pUserName, const char *pRequest, long pMType)
+{
+	std::map<std::string, std::vector<long> >::iterator 	lIter;		//!< Entry of the request in flight
+	std::string 											lKey = makeKey(pUserName, pRequest);
+	bool 													lIsJoined = false;
+
+	pthread_mutex_lock(&_mutex);
+	lIter = _inFlight.find(lKey);
+	if (lIter == _inFlight.end())
+	{
+		_inFlight[lKey];
+	}
+	else
+	{
+		lIter->second.push_back(pMType);
+		lIsJoined = true;
+	}
+	pthread_mutex_unlock(&_mutex);
+
+	if (lIsJoined)
+	{
+		SessionStats::Increment(COALESCED_REQUESTS);
+	}
+	return lIsJoined;
+}//bool RequestCoalescer::Join(const char *pUserName, const char *pRequest, long pMType)
+
+
+
+/**
+ * @fn Finish
+ * @param Name of the user
+ * @param Request sent to SPS
+ * @param Vector to which the mTypes waiting on the request are copied
+ * @ret void
+ * @brief Removes the request from the in flight map. The caller pushes the response once for each of the returned mTypes
+ */
+void RequestCoalescer::Finish(const char *pUserName, const char *pRequest, std::vector<long> &pWaiters)
+{
+	std::map<std::string, std::vector<long> >::iterator 	lIter;		//!< Entry of the request in flight
+
+	pWaiters.clear();
+
+	pthread_mutex_lock(&_mutex);
+	lIter = _inFlight.find(makeKey(pUserName, pRequest));
+	if (lIter != _inFlight.end())
+	{
+		pWaiters.swap(lIter->second);
+		_inFlight.erase(lIter);
+	}
+	pthread_mutex_unlock(&_mutex);
+}//void RequestCoalescer::Finish(...)
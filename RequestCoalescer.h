@@ -0,0 +1,40 @@
+/**
+    @file RequestCoalescer.h
+    @brief Declaration of the RequestCoalescer class used to send identical read only requests only once to SPS
+
+	When an identical read only request of the same user is already in flight, the later copies are not sent to SPS. The mType of each
+	copy is recorded against the request in flight and the single response from SPS is pushed to the Response Message Queue once for
+	every recorded mType. The root elements of the requests which are read only are configured in CoalesceRequestTypes as a comma
+	separated list. Coalescing is disabled when the list is empty.
+*/
+
+#ifndef _REQUEST_COALESCER_H_
+#define _REQUEST_COALESCER_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+namespace SPS
+{
+	class RequestCoalescer
+	{
+		public:
+			static bool IsCoalescable(const char *pRequest);
+			static bool Join(const char *pUserName, const char *pRequest, long pMType);
+			static void Finish(const char *pUserName, const char *pRequest, std::vector<long> &pWaiters);
+
+		private:
+			static void loadRequestTypes();
+			static std::string makeKey(const char *pUserName, const char *pRequest);
+
+			static pthread_mutex_t 							_mutex;				//!< Protects the in flight map
+			static bool 									_isTypesLoaded;		//!< Set once the request types are read from the configuration
+			static std::set<std::string> 					_requestTypes;		//!< Root elements of the read only requests
+			static std::map<std::string, std::vector<long> > 	_inFlight;			//!< mTypes waiting on each request in flight
+	};
+}
+
+#endif
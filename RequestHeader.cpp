@@ -0,0 +1,119 @@
+/**
+    @file RequestHeader.cpp
+    @brief This file contains the definition for all the member functions of the RequestHeader class
+
+*/
+
+#include <RequestHeader.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+using namespace SPS;
+
+#define REQUEST_HEADER_PREFIX 		"[SL "		//!< Prefix which identifies the request header
+#define REQUEST_HEADER_PREFIX_LEN 	4			//!< Length of the request header prefix
+#define REQUEST_HEADER_MAX_LEN 		128			//!< Maximum length of the header, the closing bracket is looked for only within it
+
+
+
+/**
+ * @fn RequestHeader
+ * @param Nil
+ * @brief Constructor of the RequestHeader used to intialize the member variables
+ */
+RequestHeader::RequestHeader()
+{
+	deadline = 0;
+	enqueueTime = 0;
+}
+
+
+
+/**
+ * @fn Parse
+ * @param Character pointer to the request read from the Request Message Queue
+ * @ret returns 1 if a header was present, 0 if not and -1 if the header is malformed
+ * @brief Reads the fields of the header and removes the header from the request, so that only the XML is sent to SPS. A request not
+		starting with the prefix is not scanned at all, and the closing bracket is looked for only within REQUEST_HEADER_MAX_LEN
+		characters, so that a bracket in the XML, like in a CDATA section, is never taken as the end of the header
+ */
+int RequestHeader::Parse(char *pRequest)
+{
+	char 	*lpEnd;		//!< Points to the closing bracket of the header
+	char 	*lpField;	//!< Points to the field being parsed
+
+	deadline = 0;
+	enqueueTime = 0;
+
+	if (0 != strncmp(pRequest, REQUEST_HEADER_PREFIX, REQUEST_HEADER_PREFIX_LEN))
+	{
+		return 0;
+	}
+
+	lpEnd = (char*) memchr(pRequest, ']', strnlen(pRequest, REQUEST_HEADER_MAX_LEN));
+	if (NULL == lpEnd)
+	{
+		return -1;
+	}
+
+	//! Walking through the blank separated <name>=<value> fields of the header
+	for (lpField = pRequest + REQUEST_HEADER_PREFIX_LEN; lpField < lpEnd; lpField++)
+	{
+		if (0 == strncmp(lpField, "deadline=", 9))
+		{
+			deadline = strtoll(lpField + 9, &lpField, 10);
+		}
+		else if (0 == strncmp(lpField, "enq=", 4))
+		{
+			enqueueTime = strtoll(lpField + 4, &lpField, 10);
+		}
+
+		//! Skipping the unknown fields
+		while (lpField < lpEnd && ' ' != *lpField)
+		{
+			lpField++;
+		}
+	}
+
+	//! Removing the header from the request
+	memmove(pRequest, lpEnd + 1, strlen(lpEnd + 1) + 1);
+	return 1;
+}//int RequestHeader::Parse(char *pRequest)
+
+
+
+/**
+ * @fn IsExpired
+ * @param Current time in epoch milliseconds
+ * @param Maximum time in milliseconds a request may wait in the queue, 0 to disable the check on the enqueue time
+ * @ret returns true if the caller has already given up on the request
+ */
+bool RequestHeader::IsExpired(long long pNow, int pMaxQueueAge) const
+{
+	if (0 != deadline && pNow >= deadline)
+	{
+		return true;
+	}
+	if (0 != enqueueTime && 0 < pMaxQueueAge && pNow - enqueueTime >= pMaxQueueAge)
+	{
+		return true;
+	}
+	return false;
+}//bool RequestHeader::IsExpired(long long pNow, int pMaxQueueAge) const
+
+
+
+/**
+ * @fn NowMillis
+ * @param Nil
+ * @ret returns the current time in epoch milliseconds
+ * @brief The wall clock is used since the timestamps are generated by the PHP Service Layer processes
+ */
+long long RequestHeader::NowMillis()
+{
+	struct timeval 	lNow;	//!< Current time
+
+	gettimeofday(&lNow, NULL);
+	return (long long) lNow.tv_sec * 1000 + lNow.tv_usec / 1000;
+}
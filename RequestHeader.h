@@ -0,0 +1,32 @@
+/**
+    @file RequestHeader.h
+    @brief Declaration of the RequestHeader class used to carry the control information of a request from the Service Layer
+
+	The Service Layer can optionally prefix the XML request pushed into the Request Message Queue with a header of the form
+	[SL deadline=<epoch millisec> enq=<epoch millisec>]. The deadline is the time after which the caller is no more waiting for the response
+	and enq is the time at which the request was pushed into the queue. Both the fields are optional. The header is removed before the
+	request is sent to SPS. A request whose header has no closing bracket within its first 128 characters is not sent to SPS and is
+	answered with s:17:"SessionLayerError";.
+*/
+
+#ifndef _REQUEST_HEADER_H_
+#define _REQUEST_HEADER_H_
+
+namespace SPS
+{
+	class RequestHeader
+	{
+		public:
+			long long 	deadline;		//!< Time in epoch milliseconds after which the request is expired, 0 if not set
+			long long 	enqueueTime;	//!< Time in epoch milliseconds at which the request was queued, 0 if not set
+
+			RequestHeader();
+
+			int Parse(char *pRequest);
+			bool IsExpired(long long pNow, int pMaxQueueAge) const;
+
+			static long long NowMillis();
+	};
+}
+
+#endif
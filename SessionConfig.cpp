@@ -0,0 +1,124 @@
+/**
+    @file SessionConfig.cpp
+    @brief This file contains the definition for all the member functions of the SessionConfig class
+
+*/
+
+#include <SessionConfig.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace SPS;
+
+std::map<std::string, std::string> SessionConfig::_values;		//!< Definition of the static key value map
+
+
+
+/**
+ * @fn trim
+ * @param Character pointer to the string to be trimmed
+ * @ret returns the pointer to the first non blank character
+ * @brief Removes the leading and trailing blanks of the string in place
+ */
+static char* trim(char *pStr)
+{
+	char 	*lpEnd;		//!< Used to walk back from the end of the string
+
+	while (' ' == *pStr || '\t' == *pStr)
+	{
+		pStr++;
+	}
+
+	lpEnd = pStr + strlen(pStr);
+	while (lpEnd > pStr && (' ' == lpEnd[-1] || '\t' == lpEnd[-1] || '\n' == lpEnd[-1] || '\r' == lpEnd[-1]))
+	{
+		*--lpEnd = '\0';
+	}
+	return pStr;
+}//static char* trim(char *pStr)
+
+
+
+/**
+ * @fn Load
+ * @param Character pointer to the configuration file name
+ * @ret returns the number of keys loaded and -1 if the file cannot be opened
+ * @brief Reads the <key> = <value> pairs from the configuration file
+ */
+int SessionConfig::Load(const char *pConfFile)
+{
+	FILE 	*lpFile;		//!< File pointer of the configuration file
+	char 	lLine[1024];	//!< Buffer to hold a line of the configuration file
+	char 	*lpKey;			//!< Points to the key in the line
+	char 	*lpValue;		//!< Points to the value in the line
+	int 	lCount = 0;		//!< Number of keys loaded
+
+	lpFile = fopen(pConfFile, "r");
+	if (NULL == lpFile)
+	{
+		return -1;
+	}
+
+	while (NULL != fgets(lLine, sizeof(lLine), lpFile))
+	{
+		lpKey = trim(lLine);
+
+		//! Skipping the blank lines and comments
+		if ('\0' == *lpKey || '#' == *lpKey)
+		{
+			continue;
+		}
+
+		lpValue = strchr(lpKey, '=');
+		if (NULL == lpValue)
+		{
+			continue;
+		}
+		*lpValue++ = '\0';
+
+		_values[trim(lpKey)] = trim(lpValue);
+		lCount++;
+	}
+
+	fclose(lpFile);
+	return lCount;
+}//int SessionConfig::Load(const char *pConfFile)
+
+
+
+/**
+ * @fn GetInt
+ * @param Character pointer to the key
+ * @param Default value to be returned when the key is not configured
+ * @ret returns the configured integer value of the key
+ */
+int SessionConfig::GetInt(const char *pKey, int pDefault)
+{
+	std::map<std::string, std::string>::const_iterator 	lIter = _values.find(pKey);
+
+	if (lIter == _values.end() || lIter->second.empty())
+	{
+		return pDefault;
+	}
+	return atoi(lIter->second.c_str());
+}//int SessionConfig::GetInt(const char *pKey, int pDefault)
+
+
+
+/**
+ * @fn GetString
+ * @param Character pointer to the key
+ * @param Default value to be returned when the key is not configured
+ * @ret returns the configured value of the key
+ */
+const char* SessionConfig::GetString(const char *pKey, const char *pDefault)
+{
+	std::map<std::string, std::string>::const_iterator 	lIter = _values.find(pKey);
+
+	if (lIter == _values.end())
+	{
+		return pDefault;
+	}
+	return lIter->second.c_str();
+}//const char* SessionConfig::GetString(const char *pKey, const char *pDefault)
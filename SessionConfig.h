@@ -0,0 +1,29 @@
+/**
+    @file SessionConfig.h
+    @brief Declaration of the SessionConfig class which holds the tunables of the Session Layer
+
+	The tunables are read from the Conf/session.conf file under the SESSION_LAYER_HOME path. Each line of the file is of the form <key> = <value>,
+	lines starting with # are treated as comments. A missing file or a missing key is not an error, the caller supplies the default value.
+*/
+
+#ifndef _SESSION_CONFIG_H_
+#define _SESSION_CONFIG_H_
+
+#include <map>
+#include <string>
+
+namespace SPS
+{
+	class SessionConfig
+	{
+		public:
+			static int Load(const char *pConfFile);
+			static int GetInt(const char *pKey, int pDefault);
+			static const char* GetString(const char *pKey, const char *pDefault);
+
+		private:
+			static std::map<std::string, std::string> 	_values;	//!< Key value pairs read from the configuration file
+	};
+}
+
+#endif
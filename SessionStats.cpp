@@ -0,0 +1,72 @@
+/**
+    @file SessionStats.cpp
+    @brief This file contains the definition for all the member functions of the SessionStats class
+
+*/
+
+#include <SessionStats.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace SPS;
+
+volatile long SessionStats::_counters[MAX_SESSION_COUNTER];		//!< Definition of the static counters
+
+//! Names of the counters used while writing them to the log. The order should match the SessionCounter enumeration
+static const char *GCounterNames[MAX_SESSION_COUNTER] =
+{
+	"ExpiredRequests",
+	"ShedRequests",
+	"DroppedResponses",
+	"CoalescedRequests",
+	"HeartbeatsSent",
+	"DeadConnections",
+	"DrainedRequests",
+	"DroppedCaptures"
+};
+
+
+
+/**
+ * @fn Increment
+ * @param Identifier of the counter
+ * @ret returns the value of the counter after the increment
+ * @brief Atomically increments the counter
+ */
+long SessionStats::Increment(SessionCounter pCounter)
+{
+	return __sync_add_and_fetch(&_counters[pCounter], 1);
+}
+
+
+
+/**
+ * @fn Get
+ * @param Identifier of the counter
+ * @ret returns the current value of the counter
+ */
+long SessionStats::Get(SessionCounter pCounter)
+{
+	return __sync_add_and_fetch(&_counters[pCounter], 0);
+}
+
+
+
+/**
+ * @fn Format
+ * @param Character buffer to which the counters are written
+ * @param Length of the buffer
+ * @ret void
+ * @brief Writes all the counters as <name>=<value> pairs separated by blanks, suitable for logging
+ */
+void SessionStats::Format(char *pBuf, int pBufLen)
+{
+	int 	lIndex;			//!< Used as index in loops
+	int 	lUsed = 0;		//!< Number of characters written so far
+
+	memset(pBuf, '\0', pBufLen);
+	for (lIndex = 0; lIndex < MAX_SESSION_COUNTER && lUsed < pBufLen - 1; lIndex++)
+	{
+		lUsed += snprintf(pBuf + lUsed, pBufLen - lUsed, "%s%s=%ld", (0 == lIndex) ? "" : " ", GCounterNames[lIndex], Get((SessionCounter) lIndex));
+	}
+}//void SessionStats::Format(char *pBuf, int pBufLen)
@@ -0,0 +1,39 @@
+/**
+    @file SessionStats.h
+    @brief Declaration of the process wide counters of the Session Layer
+
+	The counters are updated from the XMLIAClient threads without any lock and are written to the log on demand.
+*/
+
+#ifndef _SESSION_STATS_H_
+#define _SESSION_STATS_H_
+
+namespace SPS
+{
+	//! Identifiers of the counters maintained by the Session Layer
+	enum SessionCounter
+	{
+		EXPIRED_REQUESTS = 0,		//!< Requests answered with a timeout since the caller had already given up
+		SHED_REQUESTS,				//!< Requests answered with an error since an admission limit tripped
+		DROPPED_RESPONSES,			//!< Responses dropped since the Response Message Queue stayed full
+		COALESCED_REQUESTS,			//!< Requests answered with the response of an identical request in flight
+		HEARTBEATS_SENT,			//!< PING messages pushed for the idle connections
+		DEAD_CONNECTIONS,			//!< Idle connections found dead by a heartbeat
+		DRAINED_REQUESTS,			//!< Queued requests answered with a retriable error during shut down
+		DROPPED_CAPTURES,			//!< Messages left out of the traffic capture since its buffer was full
+		MAX_SESSION_COUNTER
+	};
+
+	class SessionStats
+	{
+		public:
+			static long Increment(SessionCounter pCounter);
+			static long Get(SessionCounter pCounter);
+			static void Format(char *pBuf, int pBufLen);
+
+		private:
+			static volatile long 	_counters[MAX_SESSION_COUNTER];		//!< Current value of each of the counters
+	};
+}
+
+#endif
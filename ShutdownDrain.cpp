@@ -0,0 +1,394 @@
+/**
+    @file ShutdownDrain.cpp
+    @brief This file contains the definition for all the member functions of the ShutdownDrain class
+
+*/
+
+#include <ShutdownDrain.h>
+#include <AdmissionControl.h>
+#include <HeartbeatMonitor.h>
+#include <QueueShards.h>
+#include <LeaseManager.h>
+#include <RequestHeader.h>
+#include <SessionConfig.h>
+#include <SessionStats.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+using namespace SPS;
+
+extern ABL_Logger gABLLoggerObj;    //!< Global ABL Logger Object for logging
+
+pthread_mutex_t 				ShutdownDrain::_mutex = PTHREAD_MUTEX_INITIALIZER;
+bool 							ShutdownDrain::_isEnabled = true;
+std::map<OSSUserInfo*, bool> 	ShutdownDrain::_draining;
+std::map<XMLIAClient*, int> 	ShutdownDrain::_sockets;
+
+
+
+/**
+ * @fn SetEnabled
+ * @param Cleared to stop the users without the drain
+ * @ret void
+ * @brief Used on the hand over from the snapshot users to the SessionLayer, where the queued requests are left for the new threads
+ */
+void ShutdownDrain::SetEnabled(bool pIsEnabled)
+{
+	_isEnabled = pIsEnabled;
+}
+
+
+
+/**
+ * @fn Begin
+ * @param User being stopped
+ * @param Stop message to be sent to the threads of the user
+ * @ret returns true if the drain thread is started, false if ShutdownDeadlineMs is not set and the stop messages should be sent as before
+ * @brief Stops the intake of the user at once and starts the drain thread. Invoked from OSSUserInfo::StopUserConnections
+ */
+bool ShutdownDrain::Begin(OSSUserInfo *pUser, const MsqQueStruct &pStopMsg)
+{
+	DrainJob 	*lpJob;				//!< Drain of the user
+	pthread_t 	lThreadId;			//!< Drain thread
+	char 		lLogMsgBuf[512];	//!< Logger Message Buffer
+	int 		lDeadline;			//!< Milliseconds given to the requests in flight
+
+	lDeadline = SessionConfig::GetInt("ShutdownDeadlineMs", 10000);
+	if (lDeadline <= 0 || !_isEnabled)
+	{
+		return false;
+	}
+
+	pthread_mutex_lock(&_mutex);
+	_draining[pUser] = true;
+	pthread_mutex_unlock(&_mutex);
+
+	lpJob = new DrainJob;
+	lpJob->user = pUser;
+	lpJob->stopMsg = pStopMsg;
+	lpJob->deadline = RequestHeader::NowMillis() + lDeadline;
+	if (0 != pthread_create(&lThreadId, NULL, drainThread, lpJob))
+	{
+		delete lpJob;
+		pthread_mutex_lock(&_mutex);
+		_draining.erase(pUser);
+		pthread_mutex_unlock(&_mutex);
+		return false;
+	}
+	pthread_detach(lThreadId);
+
+	snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Shut Down Drain Started for User : %s | Deadline : %d ms", pUser->userName, lDeadline);
+	gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+	return true;
+}//bool ShutdownDrain::Begin(OSSUserInfo *pUser, const MsqQueStruct &pStopMsg)
+
+
+
+/**
+ * @fn Wait
+ * @param User
+ * @ret returns true if the user was drained, false if it was not stopped through the drain
+ * @brief Waits till the drain thread of the user completes
+ */
+bool ShutdownDrain::Wait(OSSUserInfo *pUser)
+{
+	std::map<OSSUserInfo*, bool>::iterator 	lIter;
+	bool 									lIsDrained;
+
+	while (true)
+	{
+		pthread_mutex_lock(&_mutex);
+		lIter = _draining.find(pUser);
+		lIsDrained = (_draining.end() != lIter);
+		if (!lIsDrained || !lIter->second)
+		{
+			pthread_mutex_unlock(&_mutex);
+			return lIsDrained;
+		}
+		pthread_mutex_unlock(&_mutex);
+		usleep(10000);
+	}
+}//bool ShutdownDrain::Wait(OSSUserInfo *pUser)
+
+
+
+/**
+ * @fn IsDraining
+ * @param User
+ * @ret returns true if the user is being stopped and no more requests should be sent to SPS
+ */
+bool ShutdownDrain::IsDraining(OSSUserInfo *pUser)
+{
+	bool 	lIsDraining;
+
+	pthread_mutex_lock(&_mutex);
+	lIsDraining = (_draining.end() != _draining.find(pUser));
+	pthread_mutex_unlock(&_mutex);
+	return lIsDraining;
+}
+
+
+
+/**
+ * @fn GetClientCount
+ * @param User
+ * @ret returns the number of XMLIAClient threads of the user still alive
+ */
+int ShutdownDrain::GetClientCount(OSSUserInfo *pUser)
+{
+	return countClients(pUser, false);
+}
+
+
+
+/**
+ * @fn RemoveUser
+ * @param User being deleted
+ * @ret void
+ * @brief Forgets the drain of the user, so that a user object created later at the same address is not taken as being stopped
+ */
+void ShutdownDrain::RemoveUser(OSSUserInfo *pUser)
+{
+	pthread_mutex_lock(&_mutex);
+	_draining.erase(pUser);
+	pthread_mutex_unlock(&_mutex);
+}
+
+
+
+/**
+ * @fn Track
+ * @param XMLIAClient
+ * @param Socket descriptor of its SPS connection
+ * @ret void
+ * @brief Records the connection, so that it can be shut down at the deadline. Invoked on every new connection to SPS
+ */
+void ShutdownDrain::Track(XMLIAClient *pClient, int pSocketDesc)
+{
+	pthread_mutex_lock(&_mutex);
+	_sockets[pClient] = pSocketDesc;
+	pthread_mutex_unlock(&_mutex);
+}
+
+
+
+/**
+ * @fn Remove
+ * @param XMLIAClient whose thread is exiting, or which could not be started
+ * @ret void
+ */
+void ShutdownDrain::Remove(XMLIAClient *pClient)
+{
+	pthread_mutex_lock(&_mutex);
+	_sockets.erase(pClient);
+	pthread_mutex_unlock(&_mutex);
+}
+
+
+
+/**
+ * @fn BoundLogout
+ * @param Socket descriptor of the SPS connection
+ * @ret void
+ * @brief Limits the time the logout may wait on SPS, so that an unresponsive SPS does not hold up the shut down
+ */
+void ShutdownDrain::BoundLogout(int pSocketDesc)
+{
+	struct timeval 	lTimeout;		//!< Send and receive timeout of the socket
+	int 			lLogoutTimeout;	//!< Milliseconds given to the logout
+
+	lLogoutTimeout = SessionConfig::GetInt("ShutdownLogoutTimeoutMs", 2000);
+	if (lLogoutTimeout <= 0)
+	{
+		return;
+	}
+	lTimeout.tv_sec = lLogoutTimeout / 1000;
+	lTimeout.tv_usec = (lLogoutTimeout % 1000) * 1000;
+	setsockopt(pSocketDesc, SOL_SOCKET, SO_RCVTIMEO, &lTimeout, sizeof(lTimeout));
+	setsockopt(pSocketDesc, SOL_SOCKET, SO_SNDTIMEO, &lTimeout, sizeof(lTimeout));
+}//void ShutdownDrain::BoundLogout(int pSocketDesc)
+
+
+
+/**
+ * @fn Reject
+ * @param User
+ * @param mType of the request
+ * @param Structure to which the response is written, can be passed on to the coalesced requests by the caller
+ * @param Set to wait on a full Response Message Queue as for any response, cleared to drop the response at once
+ * @ret void
+ * @brief Answers the request with the retriable response, so that the Service Layer can send it again once the Session Layer is back
+ */
+void ShutdownDrain::Reject(OSSUserInfo *pUser, long pMType, MsqQueStruct &pRespMsg, bool pIsWaiting)
+{
+	memset(pRespMsg.xmlRequest, '\0', sizeof(pRespMsg.xmlRequest));
+	strcpy(pRespMsg.xmlRequest, "s:17:\"SessionLayerRetry\";");
+	pRespMsg.mType = pMType;
+	if (pIsWaiting)
+	{
+		AdmissionControl::PushResponse(pUser, pRespMsg);
+	}
+	else
+	{
+		AdmissionControl::TryPushResponse(pUser, pRespMsg);
+	}
+	SessionStats::Increment(DRAINED_REQUESTS);
+}
+
+
+
+/**
+ * @fn drainThread
+ * @param Pointer to the DrainJob, deleted by the thread
+ * @ret NULL
+ */
+void* ShutdownDrain::drainThread(void *pArg)
+{
+	DrainJob 			*lpJob = (DrainJob*) pArg;
+	OSSUserInfo 		*lpUser = lpJob->user;
+	std::vector<int> 	lStopsLeft;			//!< Stop messages still to be sent to each shard
+	char 				lLogMsgBuf[512];	//!< Logger Message Buffer
+	long long 			lStartTime;			//!< Time in epoch milliseconds at which the drain started
+	long long 			lHardLimit;			//!< Time in epoch milliseconds after which the drain stops waiting for the threads
+	bool 				lIsShared;			//!< Set when another instance is live and takes over the queued requests
+	int 				lAnswered = 0;		//!< Queued requests answered with the retriable response
+	int 				lFailed = 0;		//!< Connections shut down at the deadline
+	int 				lShard;				//!< Used as index in loops over the shards
+
+	lStartTime = RequestHeader::NowMillis();
+	lHardLimit = lpJob->deadline + SessionConfig::GetInt("ShutdownLogoutTimeoutMs", 2000) + 1000;
+	lIsShared = !LeaseManager::IsLastInstance();
+
+	//! Sending the stop messages first, each thread takes its own ahead of the queued requests. A stop message which does not fit in a
+	//! full queue is sent again on the next round, once the queued requests are answered
+	for (lShard = 0; lShard < QueueShards::GetShardCount(lpUser); lShard++)
+	{
+		lStopsLeft.push_back(QueueShards::GetThreadCount(lpUser, lShard));
+	}
+	sendStops(lpJob, lStopsLeft);
+
+	//! Waiting for the requests in flight. The requests pushed meanwhile are answered as they arrive
+	while (RequestHeader::NowMillis() < lpJob->deadline && 0 < countClients(lpUser, false))
+	{
+		lAnswered += lIsShared ? 0 : answerQueued(lpUser, lpJob->deadline);
+		sendStops(lpJob, lStopsLeft);
+		usleep(10000);
+	}
+
+	//! Failing the requests still in flight at the deadline
+	if (RequestHeader::NowMillis() >= lpJob->deadline)
+	{
+		lFailed = countClients(lpUser, true);
+	}
+	while (RequestHeader::NowMillis() < lHardLimit && 0 < countClients(lpUser, false))
+	{
+		lAnswered += lIsShared ? 0 : answerQueued(lpUser, lHardLimit);
+		sendStops(lpJob, lStopsLeft);
+		usleep(10000);
+	}
+	lAnswered += lIsShared ? 0 : answerQueued(lpUser, lHardLimit);
+
+	snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Shut Down Drain Completed for User : %s | Answered Queued Requests : %d | Connections Failed at Deadline : %d | Threads Left : %d | Time Taken : %lld ms",
+		lpUser->userName, lAnswered, lFailed, countClients(lpUser, false), RequestHeader::NowMillis() - lStartTime);
+	gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+
+	delete lpJob;
+	pthread_mutex_lock(&_mutex);
+	_draining[lpUser] = false;
+	pthread_mutex_unlock(&_mutex);
+	lpUser->stopNowSemaphore.mb_release();
+	return NULL;
+}//void* ShutdownDrain::drainThread(void *pArg)
+
+
+
+/**
+ * @fn sendStops
+ * @param Drain of the user
+ * @param Stop messages still to be sent to each shard, decreased as they are sent
+ * @ret void
+ * @brief Sends the stop messages without blocking on a full Request Message Queue
+ */
+void ShutdownDrain::sendStops(DrainJob *pJob, std::vector<int> &pStopsLeft)
+{
+	int 	lQueueId;		//!< Request Message Queue of a shard
+	int 	lShard;			//!< Used as index in loops over the shards
+
+	for (lShard = 0; lShard < pStopsLeft.size(); lShard++)
+	{
+		lQueueId = QueueShards::GetRequestQueueId(pJob->user, lShard);
+		while (0 <= lQueueId && 0 < pStopsLeft[lShard] && 0 == msgsnd(lQueueId, &pJob->stopMsg, sizeof(pJob->stopMsg.xmlRequest), IPC_NOWAIT))
+		{
+			pStopsLeft[lShard]--;
+		}
+	}
+}//void ShutdownDrain::sendStops(DrainJob *pJob, std::vector<int> &pStopsLeft)
+
+
+
+/**
+ * @fn answerQueued
+ * @param User
+ * @param Time in epoch milliseconds after which no more requests are answered
+ * @ret returns the number of requests answered
+ * @brief Reads every message other than the stop messages from the Request Message Queues of the shards held by this instance without
+		blocking, the lowest mType first, which leaves out the stop messages of all the user objects. The requests are answered with the
+		retriable response and the PING messages are dropped
+ */
+int ShutdownDrain::answerQueued(OSSUserInfo *pUser, long long pLimit)
+{
+	MsqQueStruct 	lMsg;			//!< Message read from the queue
+	MsqQueStruct 	lRespMsg;		//!< Retriable response
+	int 			lQueueId;		//!< Request Message Queue of a shard
+	int 			lAnswered = 0;	//!< Requests answered
+	int 			lShard;			//!< Used as index in loops over the shards
+
+	for (lShard = 0; lShard < QueueShards::GetShardCount(pUser) && RequestHeader::NowMillis() < pLimit; lShard++)
+	{
+		if (!LeaseManager::IsOwned(pUser, lShard))
+		{
+			continue;
+		}
+		lQueueId = QueueShards::GetRequestQueueId(pUser, lShard);
+		while (0 <= lQueueId && RequestHeader::NowMillis() < pLimit && 0 <= msgrcv(lQueueId, &lMsg, sizeof(lMsg.xmlRequest), 1 - STOP_MTYPE_BASE, IPC_NOWAIT | MSG_NOERROR))
+		{
+			if (HEARTBEAT_MTYPE == lMsg.mType)
+			{
+				HeartbeatMonitor::Consumed(pUser);
+				continue;
+			}
+			Reject(pUser, lMsg.mType, lRespMsg, false);
+			lAnswered++;
+		}
+	}
+	return lAnswered;
+}//int ShutdownDrain::answerQueued(OSSUserInfo *pUser, long long pLimit)
+
+
+
+/**
+ * @fn countClients
+ * @param User
+ * @param Set to shut down the SPS connections of the user
+ * @ret returns the number of XMLIAClient threads of the user still alive
+ */
+int ShutdownDrain::countClients(OSSUserInfo *pUser, bool pIsShutdown)
+{
+	std::map<XMLIAClient*, int>::iterator 	lIter;
+	int 									lCount = 0;
+
+	pthread_mutex_lock(&_mutex);
+	for (lIter = _sockets.begin(); lIter != _sockets.end(); lIter++)
+	{
+		if (pUser == lIter->first->pOssUserInfo)
+		{
+			if (pIsShutdown)
+			{
+				shutdown(lIter->second, SHUT_RDWR);
+			}
+			lCount++;
+		}
+	}
+	pthread_mutex_unlock(&_mutex);
+	return lCount;
+}//int ShutdownDrain::countClients(OSSUserInfo *pUser, bool pIsShutdown)
@@ -0,0 +1,63 @@
+/**
+    @file ShutdownDrain.h
+    @brief Declaration of the ShutdownDrain class which stops the connections of a user within a deadline
+
+	Without the drain, each thread takes its stop message ahead of the requests waiting in the Request Message Queues and stops after
+	its current request, leaving the backlog unanswered. When ShutdownDeadlineMs is set, stopping a user starts a drain thread instead:
+		- The XMLIAClient threads stop taking requests at once. A request read after the stop is answered with the retriable
+		  s:17:"SessionLayerRetry"; response and not sent to SPS.
+		- The drain thread sends the stop messages, which each thread takes ahead of the queued requests, and answers the queued requests
+		  of the shards held by this instance with the same response, without waiting on a full Response Message Queue. When another
+		  instance is live the queued requests are left to it, as it takes over the shards. The requests in flight finish normally.
+		- At the deadline the SPS connections still busy are shut down, so their requests fail fast with the retriable response.
+		- Each thread logs out of SPS on its own, so all the connections log out in parallel, within ShutdownLogoutTimeoutMs.
+	The users are drained in parallel, and stopNowSemaphore of a user is released once its threads are gone, or at the deadline plus
+	the logout timeout at the latest.
+*/
+
+#ifndef _SHUTDOWN_DRAIN_H_
+#define _SHUTDOWN_DRAIN_H_
+
+#include <XMLIAClient.h>
+#include <map>
+#include <vector>
+#include <pthread.h>
+
+namespace SPS
+{
+	//! Drain of a user, owned by the drain thread
+	struct DrainJob
+	{
+		OSSUserInfo 	*user;			//!< User being stopped
+		MsqQueStruct 	stopMsg;		//!< Stop message sent to the threads of the user
+		long long 		deadline;		//!< Time in epoch milliseconds by which the requests in flight are failed
+	};
+
+	class ShutdownDrain
+	{
+		public:
+			static void SetEnabled(bool pIsEnabled);
+			static bool Begin(OSSUserInfo *pUser, const MsqQueStruct &pStopMsg);
+			static bool Wait(OSSUserInfo *pUser);
+			static bool IsDraining(OSSUserInfo *pUser);
+			static int GetClientCount(OSSUserInfo *pUser);
+			static void RemoveUser(OSSUserInfo *pUser);
+			static void Track(XMLIAClient *pClient, int pSocketDesc);
+			static void Remove(XMLIAClient *pClient);
+			static void BoundLogout(int pSocketDesc);
+			static void Reject(OSSUserInfo *pUser, long pMType, MsqQueStruct &pRespMsg, bool pIsWaiting);
+
+		private:
+			static void* drainThread(void *pArg);
+			static void sendStops(DrainJob *pJob, std::vector<int> &pStopsLeft);
+			static int answerQueued(OSSUserInfo *pUser, long long pLimit);
+			static int countClients(OSSUserInfo *pUser, bool pIsShutdown);
+
+			static pthread_mutex_t 				_mutex;			//!< Protects the maps
+			static bool 						_isEnabled;		//!< Cleared while the users are stopped without the drain
+			static std::map<OSSUserInfo*, bool> 	_draining;		//!< Users being stopped, true while the drain thread runs
+			static std::map<XMLIAClient*, int> 	_sockets;		//!< SPS connection of each live XMLIAClient
+	};
+}
+
+#endif
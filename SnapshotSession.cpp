@@ -0,0 +1,434 @@
+/**
+    @file SnapshotSession.cpp
+    @brief This file contains the definition for all the member functions of the SnapshotSession class
+
+*/
+
+#include <SnapshotSession.h>
+#include <SessionConfig.h>
+#include <ShutdownDrain.h>
+#include <QueueShards.h>
+#include <ABL_Exception.h>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+
+using namespace SPS;
+
+extern ABL_Logger gABLLoggerObj;    //!< Global ABL Logger Object for logging
+
+#define SNAPSHOT_STOP_WAIT 		5		//!< Seconds given to the XMLIAClient threads to logout on shut down, and between the logs on the hand over
+
+//! Arguments of the thread saving the snapshot
+struct SnapshotSaveArg
+{
+	char 	fileName[1024];		//!< Snapshot file
+	int 	settleTime;			//!< Seconds the users loaded by the SessionLayer should stay the same before the first save
+	int 	interval;			//!< Seconds between the refreshes of the snapshot, 0 to write it once
+};
+
+//! Users collected for the snapshot
+struct SnapshotUsers
+{
+	std::vector<SnapshotUser> 	records;	//!< Records of the distinct users
+	std::set<std::string> 		names;		//!< Used to skip the users already added
+};
+
+
+
+pthread_mutex_t 	SnapshotSession::_serverMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/**
+ * @fn SnapshotSession
+ * @param Full path of the stop file
+ * @param Full path of the file indicating the successful stop
+ * @brief Constructor of the SnapshotSession used to intialize the member variables
+ */
+SnapshotSession::SnapshotSession(char *pStopFile, char *pStoppedIndiFile)
+{
+	strcpy(_stopFileName, pStopFile);
+	strcpy(_stoppedIndiFileName, pStoppedIndiFile);
+}
+
+
+
+/**
+ * @fn userThread
+ * @param Pointer to the OSSUserInfo
+ * @ret NULL
+ * @brief Thread creating the queues and the SPS connections of a user. CreateSPSConnections returns once the user is stopped
+ */
+void* SnapshotSession::userThread(void *pArg)
+{
+	OSSUserInfo 	*lpUser = (OSSUserInfo*) pArg;
+
+	lpUser->CreateQueues();
+	lpUser->CreateSPSConnections();
+	return NULL;
+}//void* SnapshotSession::userThread(void *pArg)
+
+
+
+/**
+ * @fn Start
+ * @param Snapshot opened by the caller
+ * @ret returns 0 on success and -1 if the snapshot has no user or no SPS server
+ * @brief Fills the SPS server details and starts the connections of every user present in the snapshot
+ */
+int SnapshotSession::Start(const ConfigSnapshot &pSnapshot)
+{
+	SPSServerInfo 			*lpServer;			//!< Server created from the snapshot
+	OSSUserInfo 			*lpUser;			//!< User created from the snapshot
+	const SnapshotServer 	*lpSnapServer;		//!< Server record of the snapshot
+	const SnapshotUser 		*lpSnapUser;		//!< User record of the snapshot
+	pthread_t 				lThreadId;			//!< Thread of the user
+	char 					lLogMsgBuf[512];	//!< Logger Message Buffer
+	int 					lIndex;				//!< Used as index in loops
+
+	if (0 == pSnapshot.GetUserCount() || 0 == pSnapshot.GetServerCount())
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&_serverMutex);
+	for (lIndex = 0; lIndex < pSnapshot.GetServerCount(); lIndex++)
+	{
+		lpSnapServer = pSnapshot.GetServer(lIndex);
+		lpServer = new SPSServerInfo;
+		strcpy(lpServer->ipAddress, lpSnapServer->ipAddress);
+		lpServer->portNum = lpSnapServer->portNum;
+		lpServer->retryAttempt = lpSnapServer->retryAttempt;
+		lpServer->retryInterval = lpSnapServer->retryInterval;
+		strcpy(lpServer->spsHomePath, lpSnapServer->spsHomePath);
+		XMLIAClient::spsSerInfoVec.push_back(lpServer);
+	}
+	pthread_mutex_unlock(&_serverMutex);
+
+	for (lIndex = 0; lIndex < pSnapshot.GetUserCount(); lIndex++)
+	{
+		lpSnapUser = pSnapshot.GetUser(lIndex);
+		lpUser = new OSSUserInfo(_stopFileName);
+		strcpy(lpUser->userName, lpSnapUser->userName);
+		strcpy(lpUser->password, lpSnapUser->password);
+		lpUser->requestQueueKey = lpSnapUser->requestQueueKey;
+		lpUser->responseQueueKey = lpSnapUser->responseQueueKey;
+		lpUser->maxConnection = lpSnapUser->maxConnection;
+		strcpy(lpUser->touchFileName, lpSnapUser->touchFileName);
+		lpUser->isConnected = false;
+
+		memset(lLogMsgBuf, '\0', sizeof(lLogMsgBuf));
+		sprintf(lLogMsgBuf, "Starting User from Snapshot : %s | Max Connections : %d", lpUser->userName, lpUser->maxConnection);
+		gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+
+		if (0 == pthread_create(&lThreadId, NULL, userThread, lpUser))
+		{
+			_userThreads.push_back(lThreadId);
+		}
+		_users.push_back(lpUser);
+	}
+	return 0;
+}//int SnapshotSession::Start(const ConfigSnapshot &pSnapshot)
+
+
+
+/**
+ * @fn stopUsers
+ * @param Set when the SessionLayer takes over the queues, cleared when the Session Layer is shutting down
+ * @ret void
+ * @brief Sends the stop messages to the connections of all the snapshot users and deletes the users once their threads are gone. The
+		message queues are kept, as they are taken over by the SessionLayer. On the hand over the users are stopped without the shut
+		down drain, so that the queued requests are served by the SessionLayer instead of being answered with an error, and the
+		SessionLayer is started only after all the threads are gone, however long their requests in flight take. On shut down the
+		threads get SNAPSHOT_STOP_WAIT seconds after the drain
+ */
+void SnapshotSession::stopUsers(bool pIsHandover)
+{
+	char 	lLogMsgBuf[512];		//!< Logger Message Buffer
+	int 	lThreadCount;			//!< XMLIAClient threads of the snapshot users still alive
+	int 	lWaited;				//!< Time in hundredths of a second spent waiting for the threads
+	int 	lIndex;					//!< Used as index in loops
+
+	ShutdownDrain::SetEnabled(!pIsHandover);
+	for (lIndex = 0; lIndex < _users.size(); lIndex++)
+	{
+		_users[lIndex]->StopUserConnections();
+	}
+	ShutdownDrain::SetEnabled(true);
+
+	//! CreateSPSConnections returns once the stop now semaphore of the user is released, by StopUserConnections or by the drain thread
+	for (lIndex = 0; lIndex < _userThreads.size(); lIndex++)
+	{
+		pthread_join(_userThreads[lIndex], NULL);
+	}
+	_userThreads.clear();
+	for (lIndex = 0; lIndex < _users.size(); lIndex++)
+	{
+		ShutdownDrain::Wait(_users[lIndex]);
+	}
+
+	for (lWaited = 0; ; lWaited++)
+	{
+		for (lIndex = 0, lThreadCount = 0; lIndex < _users.size(); lIndex++)
+		{
+			lThreadCount += ShutdownDrain::GetClientCount(_users[lIndex]);
+		}
+		if (0 == lThreadCount || (!pIsHandover && lWaited >= SNAPSHOT_STOP_WAIT * 100))
+		{
+			break;
+		}
+		if (0 == lWaited % (SNAPSHOT_STOP_WAIT * 100))
+		{
+			snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Waiting for the Snapshot Connections to Stop | Threads Left : %d", lThreadCount);
+			gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+		}
+		usleep(10000);
+	}
+
+	//! The users whose threads did not stop by the shut down are left to the process exit
+	for (lIndex = 0; lIndex < _users.size(); lIndex++)
+	{
+		if (0 == ShutdownDrain::GetClientCount(_users[lIndex]))
+		{
+			QueueShards::HandOver(_users[lIndex]);
+			delete _users[lIndex];
+		}
+	}
+	_users.clear();
+}//void SnapshotSession::stopUsers(bool pIsHandover)
+
+
+
+/**
+ * @fn Run
+ * @param SessionLayer which will take over once the database is reachable
+ * @param Database configuration file
+ * @ret returns 0 if the Session Layer was stopped and 1 if the database is reachable and the SessionLayer has to be started
+ * @brief Watches the stop file and retries the database connection every DBRetryIntervalSec seconds
+ */
+int SnapshotSession::Run(SessionLayer &pSessionLayer, char *pDBConfFile)
+{
+	struct stat 	lFileInfo;			//!< Used with stat to check the stop file
+	char 			lTouchCmd[2048];	//!< Touch command used to create the stopped indicator file
+	int 			lRetryInterval;		//!< Seconds between the database connection attempts
+	int 			lElapsed = 0;		//!< Seconds since the last database connection attempt
+	int 			lIndex;				//!< Used as index in loops
+	int 			lReturn;			//!< Used to hold the return values during function calls
+
+	lRetryInterval = SessionConfig::GetInt("DBRetryIntervalSec", 30);
+
+	while (true)
+	{
+		sleep(1);
+
+		//! Stop file is created by the signal handler or when no connection can be established to SPS
+		if (0 == stat(_stopFileName, &lFileInfo))
+		{
+			gABLLoggerObj<<INFO<<"Stop File Found : Stopping the Snapshot Users"<<Endl;
+			stopUsers(false);
+			remove(_stopFileName);
+
+			strcpy(lTouchCmd, "touch ");
+			strcat(lTouchCmd, _stoppedIndiFileName);
+			system(lTouchCmd);
+			return 0;
+		}
+
+		if (++lElapsed < lRetryInterval)
+		{
+			continue;
+		}
+		lElapsed = 0;
+
+		try
+		{
+			lReturn = pSessionLayer.EstablishDBConnection(pDBConfFile);
+		}
+		catch (ABL_Exception)
+		{
+			lReturn = -1;
+		}
+
+		if (0 == lReturn)
+		{
+			gABLLoggerObj<<INFO<<"Database Reachable : Handing Over from the Snapshot to the Database Configuration"<<Endl;
+			stopUsers(true);
+			pthread_mutex_lock(&_serverMutex);
+			for (lIndex = 0; lIndex < XMLIAClient::spsSerInfoVec.size(); lIndex++)
+			{
+				delete XMLIAClient::spsSerInfoVec[lIndex];
+			}
+			XMLIAClient::spsSerInfoVec.clear();
+			pthread_mutex_unlock(&_serverMutex);
+			return 1;
+		}
+		gABLLoggerObj<<INFO<<"Database still not Reachable : Continuing with the Snapshot Configuration"<<Endl;
+	}
+}//int SnapshotSession::Run(SessionLayer &pSessionLayer, char *pDBConfFile)
+
+
+
+/**
+ * @fn collectUser
+ * @param User whose queues are created
+ * @param Pointer to the SnapshotUsers
+ * @ret void
+ * @brief Adds the user to the snapshot, whether or not its connections are up. Invoked through QueueShards::ForEachUser
+ */
+void SnapshotSession::collectUser(OSSUserInfo *pUser, void *pArg)
+{
+	SnapshotUsers 	*lpUsers = (SnapshotUsers*) pArg;
+	SnapshotUser 	lRecord;
+
+	if (lpUsers->names.insert(pUser->userName).second)
+	{
+		ConfigSnapshot::FillUser(lRecord, pUser);
+		lpUsers->records.push_back(lRecord);
+	}
+}
+
+
+
+/**
+ * @fn waitForStart
+ * @param Seconds the users should stay the same
+ * @ret void
+ * @brief Waits till the SessionLayer has created the queues of its users and attempted all their SPS connections, and no user was added
+		for the settle time, so that the first snapshot is not taken while the users are still being loaded
+ */
+void SnapshotSession::waitForStart(int pSettleTime)
+{
+	int 	lUserCount;			//!< Users whose queues are created
+	int 	lLastCount = -1;	//!< Users seen on the previous check
+	int 	lSettled = 0;		//!< Seconds for which the users stayed the same
+
+	while (lSettled < pSettleTime)
+	{
+		sleep(1);
+		if (!QueueShards::IsAllStarted(lUserCount) || lUserCount != lLastCount)
+		{
+			lSettled = 0;
+		}
+		else
+		{
+			lSettled++;
+		}
+		lLastCount = lUserCount;
+	}
+}//void SnapshotSession::waitForStart(int pSettleTime)
+
+
+
+/**
+ * @fn save
+ * @param Snapshot file
+ * @param Users to be written
+ * @param Buffer receiving the result to be logged
+ * @param Length of the buffer
+ * @ret returns 0 if the snapshot was written and -1 if not
+ * @brief A snapshot holding more users than the current ones is kept, so that users which failed to load, or a partial load, never
+		shrink the snapshot the next start may depend on
+ */
+int SnapshotSession::save(const char *pFileName, std::vector<SnapshotUser> &pUsers, char *pLogMsg, int pLogLen)
+{
+	ConfigSnapshot 	lCurrent;		//!< Snapshot being replaced
+	int 			lReturn = -1;
+
+	if (0 == lCurrent.Open(pFileName) && lCurrent.GetUserCount() > (int) pUsers.size())
+	{
+		snprintf(pLogMsg, pLogLen, "Configuration Snapshot not Written : %s has %d Users, only %d Loaded", pFileName, lCurrent.GetUserCount(), (int) pUsers.size());
+		return -1;
+	}
+	lCurrent.Close();
+
+	pthread_mutex_lock(&_serverMutex);
+	if (XMLIAClient::spsSerInfoVec.empty())
+	{
+		snprintf(pLogMsg, pLogLen, "Configuration Snapshot not Written : No Server Loaded");
+	}
+	else if (0 == (lReturn = ConfigSnapshot::Save(pFileName, pUsers, XMLIAClient::spsSerInfoVec)))
+	{
+		snprintf(pLogMsg, pLogLen, "Configuration Snapshot Written : %s | Users : %d | Servers : %d", pFileName, (int) pUsers.size(), (int) XMLIAClient::spsSerInfoVec.size());
+	}
+	else
+	{
+		snprintf(pLogMsg, pLogLen, "Unable to Write the Configuration Snapshot : %s", pFileName);
+	}
+	pthread_mutex_unlock(&_serverMutex);
+	return lReturn;
+}//int SnapshotSession::save(...)
+
+
+
+/**
+ * @fn saveThread
+ * @param Pointer to the SnapshotSaveArg
+ * @ret NULL
+ * @brief Waits for the SessionLayer to load the users and writes the users and servers it loaded to the snapshot, again every interval
+		so that the snapshot follows the changes made in the database
+ */
+void* SnapshotSession::saveThread(void *pArg)
+{
+	SnapshotSaveArg 	*lpArg = (SnapshotSaveArg*) pArg;
+	SnapshotUsers 		lUsers;				//!< Distinct users whose queues are created
+	char 				lLogMsgBuf[1536];	//!< Logger Message Buffer
+
+	waitForStart(lpArg->settleTime);
+
+	while (true)
+	{
+		lUsers.records.clear();
+		lUsers.names.clear();
+		QueueShards::ForEachUser(collectUser, &lUsers);
+
+		memset(lLogMsgBuf, '\0', sizeof(lLogMsgBuf));
+		if (lUsers.records.empty())
+		{
+			sprintf(lLogMsgBuf, "Configuration Snapshot not Written : No User Loaded");
+		}
+		else
+		{
+			save(lpArg->fileName, lUsers.records, lLogMsgBuf, sizeof(lLogMsgBuf));
+		}
+		gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+
+		if (lpArg->interval <= 0)
+		{
+			break;
+		}
+		sleep(lpArg->interval);
+	}
+
+	delete lpArg;
+	return NULL;
+}//void* SnapshotSession::saveThread(void *pArg)
+
+
+
+/**
+ * @fn ScheduleSave
+ * @param Snapshot file
+ * @param Seconds the users loaded by the SessionLayer should stay the same before the first save
+ * @param Seconds between the refreshes of the snapshot, 0 to write it once
+ * @ret void
+ * @brief Writes the snapshot in the background once the SessionLayer has loaded the configuration from the database and started the
+		connections of all the users
+ */
+void SnapshotSession::ScheduleSave(const char *pFileName, int pSettleTime, int pInterval)
+{
+	SnapshotSaveArg 	*lpArg = new SnapshotSaveArg;
+	pthread_t 			lThreadId;
+
+	strncpy(lpArg->fileName, pFileName, sizeof(lpArg->fileName) - 1);
+	lpArg->fileName[sizeof(lpArg->fileName) - 1] = '\0';
+	lpArg->settleTime = pSettleTime;
+	lpArg->interval = pInterval;
+
+	if (0 != pthread_create(&lThreadId, NULL, saveThread, lpArg))
+	{
+		delete lpArg;
+		return;
+	}
+	pthread_detach(lThreadId);
+}//void SnapshotSession::ScheduleSave(const char *pFileName, int pSettleTime, int pInterval)
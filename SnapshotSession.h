@@ -0,0 +1,48 @@
+/**
+    @file SnapshotSession.h
+    @brief Declaration of the SnapshotSession class which runs the Session Layer from the configuration snapshot
+
+	When the database cannot be reached at start up, the users and SPS servers are taken from the snapshot written by the last successful
+	load and the connections are established right away. The database connection is retried in the background and once it succeeds, the
+	snapshot connections are stopped so that the SessionLayer can take over with the configuration loaded from the database. The
+	SessionLayer is started only once all the snapshot threads are gone, and the message queues are kept across the hand over, so no
+	queued request is lost.
+*/
+
+#ifndef _SNAPSHOT_SESSION_H_
+#define _SNAPSHOT_SESSION_H_
+
+#include <SessionLayer.h>
+#include <ConfigSnapshot.h>
+#include <vector>
+
+namespace SPS
+{
+	class SnapshotSession
+	{
+		public:
+			SnapshotSession(char *pStopFile, char *pStoppedIndiFile);
+
+			int Start(const ConfigSnapshot &pSnapshot);
+			int Run(SessionLayer &pSessionLayer, char *pDBConfFile);
+
+			static void ScheduleSave(const char *pFileName, int pSettleTime, int pInterval);
+
+		private:
+			static void* userThread(void *pArg);
+			static void* saveThread(void *pArg);
+			static void collectUser(OSSUserInfo *pUser, void *pArg);
+			static void waitForStart(int pSettleTime);
+			static int save(const char *pFileName, std::vector<SnapshotUser> &pUsers, char *pLogMsg, int pLogLen);
+			void stopUsers(bool pIsHandover);
+
+			char 						_stopFileName[1024];			//!< Stop file created to stop the Session Layer
+			char 						_stoppedIndiFileName[1024];		//!< File created once the Session Layer has stopped
+			std::vector<OSSUserInfo*> 	_users;							//!< Users started from the snapshot
+			std::vector<pthread_t> 		_userThreads;					//!< Threads creating the connections of the users
+
+			static pthread_mutex_t 		_serverMutex;					//!< Protects XMLIAClient::spsSerInfoVec against the hand over
+	};
+}
+
+#endif
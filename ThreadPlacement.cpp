@@ -0,0 +1,259 @@
+/**
+    @file ThreadPlacement.cpp
+    @brief This file contains the definition for all the member functions of the ThreadPlacement class
+
+*/
+
+#include <ThreadPlacement.h>
+#include <SessionConfig.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <errno.h>
+
+using namespace SPS;
+
+extern ABL_Logger gABLLoggerObj;    //!< Global ABL Logger Object for logging
+
+pthread_mutex_t 				ThreadPlacement::_mutex = PTHREAD_MUTEX_INITIALIZER;
+std::map<OSSUserInfo*, int> 	ThreadPlacement::_nextCpu;
+
+#define THREAD_STACK_MAX_KB 	1048576		//!< Largest ThreadStackSizeKB accepted, 1 GB
+
+
+
+/**
+ * @fn Prepare
+ * @param User of the thread being created
+ * @param Attributes of the thread, initialised when true is returned
+ * @param CPUs of the calling thread, restored by Restore
+ * @ret returns true if a placement is configured for the user, the attributes should then be passed to the thread creation
+ * @brief Sets the stack size and the CPUs of the new thread in the attributes and moves the calling thread to the same CPUs
+ */
+bool ThreadPlacement::Prepare(OSSUserInfo *pUser, pthread_attr_t *pAttr, cpu_set_t *pSavedCpus)
+{
+	cpu_set_t 	lCpus;				//!< CPUs configured for the user
+	cpu_set_t 	lThreadCpus;		//!< CPUs of the new thread
+	char 		lLogMsgBuf[512];	//!< Logger Message Buffer
+	size_t 		lStackSize;			//!< Stack size of the new thread in bytes
+	bool 		lHasCpus;			//!< Set when CPUs are configured for the user
+	int 		lPosition;			//!< Position in the set of the CPU of the new thread
+	int 		lCpu;				//!< Used as index in loops
+
+	CPU_ZERO(pSavedCpus);
+	lStackSize = getStackSize(pUser);
+	lHasCpus = parseCpuSet(getUserValue(pUser, "CpuSet"), &lCpus);
+
+	//! Only the CPUs the process may run on are used, a thread pinned to other CPUs cannot be created
+	if (lHasCpus && 0 == sched_getaffinity(0, sizeof(lThreadCpus), &lThreadCpus))
+	{
+		CPU_AND(&lCpus, &lCpus, &lThreadCpus);
+		lHasCpus = (0 < CPU_COUNT(&lCpus));
+	}
+	if (0 == lStackSize && !lHasCpus)
+	{
+		return false;
+	}
+
+	pthread_attr_init(pAttr);
+	if (0 < lStackSize)
+	{
+		pthread_attr_setstacksize(pAttr, (lStackSize < PTHREAD_STACK_MIN) ? PTHREAD_STACK_MIN : lStackSize);
+	}
+
+	if (lHasCpus)
+	{
+		lThreadCpus = lCpus;
+		if (0 == strcmp(getUserValue(pUser, "ThreadPinMode"), "core"))
+		{
+			pthread_mutex_lock(&_mutex);
+			lPosition = _nextCpu[pUser]++ % CPU_COUNT(&lCpus);
+			pthread_mutex_unlock(&_mutex);
+
+			CPU_ZERO(&lThreadCpus);
+			for (lCpu = 0; lCpu < CPU_SETSIZE; lCpu++)
+			{
+				if (CPU_ISSET(lCpu, &lCpus) && 0 == lPosition--)
+				{
+					CPU_SET(lCpu, &lThreadCpus);
+					break;
+				}
+			}
+		}
+		pthread_attr_setaffinity_np(pAttr, sizeof(lThreadCpus), &lThreadCpus);
+
+		//! Moving the calling thread, so that the pages of the new thread it touches are allocated on the NUMA node of the new thread
+		if (0 == pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), pSavedCpus) &&
+			0 != pthread_setaffinity_np(pthread_self(), sizeof(lThreadCpus), &lThreadCpus))
+		{
+			CPU_ZERO(pSavedCpus);
+		}
+	}
+
+	snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Thread Placement | User : %s | CPUs : %d | Stack Size : %d KB", pUser->userName,
+		lHasCpus ? CPU_COUNT(&lThreadCpus) : 0, (int) (lStackSize / 1024));
+	gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+	return true;
+}//bool ThreadPlacement::Prepare(OSSUserInfo *pUser, pthread_attr_t *pAttr, cpu_set_t *pSavedCpus)
+
+
+
+/**
+ * @fn getStackSize
+ * @param User of the thread being created
+ * @ret returns the stack size in bytes configured for the user, 0 for the system default or when the value is not valid
+ */
+size_t ThreadPlacement::getStackSize(OSSUserInfo *pUser)
+{
+	const char 		*lpValue;			//!< Value of ThreadStackSizeKB
+	char 			*lpEnd;				//!< End of the number
+	unsigned long 	lStackSizeKB;		//!< Stack size in KB
+	char 			lLogMsgBuf[512];	//!< Logger Message Buffer
+
+	lpValue = getUserValue(pUser, "ThreadStackSizeKB");
+	while (' ' == *lpValue)
+	{
+		lpValue++;
+	}
+	if ('\0' == *lpValue)
+	{
+		return 0;
+	}
+
+	errno = 0;
+	lStackSizeKB = strtoul(lpValue, &lpEnd, 10);
+	if ('-' == *lpValue || lpEnd == lpValue || '\0' != *lpEnd || 0 != errno || THREAD_STACK_MAX_KB < lStackSizeKB)
+	{
+		snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Invalid ThreadStackSizeKB for User : %s | Value : %s | Allowed : 0 to %d | Using the System Default", pUser->userName, lpValue, THREAD_STACK_MAX_KB);
+		gABLLoggerObj<<_ERROR<<lLogMsgBuf<<Endl;
+		return 0;
+	}
+	return (size_t) lStackSizeKB * 1024;
+}//size_t ThreadPlacement::getStackSize(OSSUserInfo *pUser)
+
+
+
+/**
+ * @fn RemoveUser
+ * @param User object being deleted
+ * @ret void
+ * @brief Forgets the next CPU of the user, so that a user object created later at the same address starts from the first CPU
+ */
+void ThreadPlacement::RemoveUser(OSSUserInfo *pUser)
+{
+	pthread_mutex_lock(&_mutex);
+	_nextCpu.erase(pUser);
+	pthread_mutex_unlock(&_mutex);
+}
+
+
+
+/**
+ * @fn Restore
+ * @param Attributes initialised by Prepare
+ * @param CPUs of the calling thread saved by Prepare
+ * @ret void
+ * @brief Moves the calling thread back to its CPUs once the new thread is created
+ */
+void ThreadPlacement::Restore(pthread_attr_t *pAttr, cpu_set_t *pSavedCpus)
+{
+	if (0 < CPU_COUNT(pSavedCpus))
+	{
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), pSavedCpus);
+	}
+	pthread_attr_destroy(pAttr);
+}
+
+
+
+/**
+ * @fn parseCpuSet
+ * @param Value of CpuSet, like 0-7,16-23 or node1
+ * @param Set to which the CPUs are added
+ * @ret returns true if at least one CPU is present in the set
+ */
+bool ThreadPlacement::parseCpuSet(const char *pValue, cpu_set_t *pCpus)
+{
+	char 	lValue[1024];		//!< Copy of the value, split on the commas
+	char 	lNodeFile[256];		//!< sysfs file listing the CPUs of a NUMA node
+	char 	lNodeCpus[1024];	//!< CPUs of a NUMA node
+	char 	*lpSavePtr;			//!< Used by strtok_r
+	char 	*lpEntry;			//!< One entry of the value
+	FILE 	*lpFile;			//!< sysfs file listing the CPUs of a NUMA node
+
+	CPU_ZERO(pCpus);
+	strncpy(lValue, pValue, sizeof(lValue) - 1);
+	lValue[sizeof(lValue) - 1] = '\0';
+
+	for (lpEntry = strtok_r(lValue, ", ", &lpSavePtr); NULL != lpEntry; lpEntry = strtok_r(NULL, ", ", &lpSavePtr))
+	{
+		if (0 != strncmp(lpEntry, "node", 4))
+		{
+			addCpuList(lpEntry, pCpus);
+			continue;
+		}
+
+		snprintf(lNodeFile, sizeof(lNodeFile), "/sys/devices/system/node/node%d/cpulist", atoi(lpEntry + 4));
+		lpFile = fopen(lNodeFile, "r");
+		if (NULL != lpFile && NULL != fgets(lNodeCpus, sizeof(lNodeCpus), lpFile))
+		{
+			addCpuList(lNodeCpus, pCpus);
+		}
+		if (NULL != lpFile)
+		{
+			fclose(lpFile);
+		}
+	}
+	return (0 < CPU_COUNT(pCpus));
+}//bool ThreadPlacement::parseCpuSet(const char *pValue, cpu_set_t *pCpus)
+
+
+
+/**
+ * @fn addCpuList
+ * @param List of CPUs and CPU ranges separated by commas, like 0-7,16-23
+ * @param Set to which the CPUs are added
+ * @ret void
+ */
+void ThreadPlacement::addCpuList(const char *pList, cpu_set_t *pCpus)
+{
+	const char 	*lpPos = pList;		//!< Current position in the list
+	char 		*lpEnd;				//!< End of the number read
+	long 		lFirst;				//!< First CPU of a range
+	long 		lLast;				//!< Last CPU of a range
+
+	while ('\0' != *lpPos)
+	{
+		lFirst = strtol(lpPos, &lpEnd, 10);
+		if (lpEnd == lpPos)
+		{
+			break;
+		}
+		lLast = lFirst;
+		if ('-' == *lpEnd)
+		{
+			lpPos = lpEnd + 1;
+			lLast = strtol(lpPos, &lpEnd, 10);
+		}
+		for (; 0 <= lFirst && lFirst <= lLast && lFirst < CPU_SETSIZE; lFirst++)
+		{
+			CPU_SET(lFirst, pCpus);
+		}
+		lpPos = (',' == *lpEnd) ? lpEnd + 1 : lpEnd;
+	}
+}//void ThreadPlacement::addCpuList(const char *pList, cpu_set_t *pCpus)
+
+
+
+/**
+ * @fn getUserValue
+ * @param User
+ * @param Configuration key
+ * @ret returns the value of <key>.<user name>, or of <key> if the user has no value of its own
+ */
+const char* ThreadPlacement::getUserValue(OSSUserInfo *pUser, const char *pKey)
+{
+	char 	lKey[256];		//!< Configuration key of the user
+
+	snprintf(lKey, sizeof(lKey), "%s.%s", pKey, pUser->userName);
+	return SessionConfig::GetString(lKey, SessionConfig::GetString(pKey, ""));
+}
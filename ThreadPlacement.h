@@ -0,0 +1,44 @@
+/**
+    @file ThreadPlacement.h
+    @brief Declaration of the ThreadPlacement class which places the XMLIAClient threads on configured CPUs with configured stack sizes
+
+	The CPUs of the threads of a user are read from CpuSet.<user name>, or from CpuSet for all the users, as a list like 0-7,16-23. An entry
+	nodeN stands for all the CPUs of NUMA node N. With ThreadPinMode = core each thread is pinned to a single CPU of the set in turn,
+	otherwise the threads float within the set. The stack size is read from ThreadStackSizeKB.<user name> or ThreadStackSizeKB.
+
+	The thread creating the XMLIAClient thread moves to the same CPUs while creating it, so that the stack and the thread local storage,
+	which pthread_create sets up, are allocated from the memory of the NUMA node of the thread. The first login of a connection is
+	sent from XMLIAClient::Start in the creating thread, so its request is rendered into the thread local buffers of the creating
+	thread; the buffers of the XMLIAClient thread are first written on a reconnect, on its own node. No latency gain of the placement
+	has been measured yet: compare the percentiles printed by TrafficReplay with and without CpuSet before relying on it.
+*/
+
+#ifndef _THREAD_PLACEMENT_H_
+#define _THREAD_PLACEMENT_H_
+
+#include <OSSUserInfo.h>
+#include <map>
+#include <sched.h>
+#include <pthread.h>
+
+namespace SPS
+{
+	class ThreadPlacement
+	{
+		public:
+			static bool Prepare(OSSUserInfo *pUser, pthread_attr_t *pAttr, cpu_set_t *pSavedCpus);
+			static void Restore(pthread_attr_t *pAttr, cpu_set_t *pSavedCpus);
+			static void RemoveUser(OSSUserInfo *pUser);
+
+		private:
+			static bool parseCpuSet(const char *pValue, cpu_set_t *pCpus);
+			static void addCpuList(const char *pList, cpu_set_t *pCpus);
+			static const char* getUserValue(OSSUserInfo *pUser, const char *pKey);
+			static size_t getStackSize(OSSUserInfo *pUser);
+
+			static pthread_mutex_t 				_mutex;			//!< Protects the next CPU of the users
+			static std::map<OSSUserInfo*, int> 	_nextCpu;		//!< Position in the set of the CPU of the next thread, used with ThreadPinMode = core
+	};
+}
+
+#endif
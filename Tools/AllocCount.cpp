@@ -0,0 +1,369 @@
+/**
+    @file AllocCount.cpp
+    @brief Heap allocation counter preloaded into the Session Layer to check that the request path does not allocate
+
+	Usage : LD_PRELOAD=${SESSION_LAYER_HOME}/Bin/AllocCount.so ${SESSION_LAYER_HOME}/Bin/Session.exe <stop file name>
+	Every malloc, calloc, realloc and memalign, and so every operator new, is counted per thread. The counts of all the threads are
+	written to the file named by ALLOC_COUNT_FILE, /tmp/AllocCount.<pid> by default, every ALLOC_COUNT_INTERVAL seconds (10 by default)
+	and at exit.
+
+	Measured window : while the file <count file>.window exists, the allocations made on the request path are counted apart. An
+	allocation is on the request path if a function whose symbol contains one of the comma separated ALLOC_COUNT_INCLUDE names
+	(XMLIAClient12startProcess by default) is on its stack, and none containing one of the ALLOC_COUNT_EXCLUDE names (ABL_Logger by
+	default, so the logger does not count). Session.exe is linked with -rdynamic so that its symbols are found. When the window file is
+	removed, <count file>.result gets one line per thread which allocated and then PASS, or FAIL with the total. Tools/alloccheck drives
+	the window around a TrafficReplay run and fails on a nonzero count. CaptureFile and CoalesceRequestTypes should be empty meanwhile.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define ALLOC_COUNT_THREADS 	4096	//!< Maximum number of threads counted, the later threads are added to the last slot
+#define ALLOC_STACK_DEPTH 		48		//!< Frames looked at to place an allocation
+#define ALLOC_MAX_NAMES 		16		//!< Maximum number of names in ALLOC_COUNT_INCLUDE and ALLOC_COUNT_EXCLUDE
+#define ALLOC_POLL_INTERVAL 	100		//!< Milliseconds between the checks of the window file
+
+extern "C"
+{
+	void* __libc_malloc(size_t pSize);
+	void* __libc_calloc(size_t pCount, size_t pSize);
+	void* __libc_realloc(void *pPtr, size_t pSize);
+	void* __libc_memalign(size_t pAlignment, size_t pSize);
+}
+
+//! Allocations made by a thread
+struct AllocSlot
+{
+	long 				threadId;		//!< Kernel thread id, 0 while the slot is free
+	unsigned long long 	count;			//!< Number of allocations
+	unsigned long long 	bytes;			//!< Bytes requested
+	unsigned long long 	windowCount;	//!< Allocations on the request path within the measured window
+};
+
+//! Comma separated symbol names, split in place
+struct NameList
+{
+	char 	buffer[1024];				//!< Copy of the environment variable
+	char 	*names[ALLOC_MAX_NAMES];	//!< Names in the buffer
+	int 	count;						//!< Number of names
+};
+
+static AllocSlot 		GSlots[ALLOC_COUNT_THREADS];	//!< Counts of the threads, a slot is owned by a single thread
+static volatile int 	GSlotCount = 0;					//!< Number of slots taken
+static __thread int 	GSlot = -1;						//!< Slot of the current thread
+static char 			GFileName[1024];				//!< File to which the counts are written
+static char 			GWindowFile[1100];				//!< File whose presence opens the measured window
+static char 			GResultFile[1100];				//!< File to which the result of the window is written
+static volatile int 	GIsInWindow = 0;				//!< Set while the measured window is open
+static __thread int 	GIsInHook = 0;					//!< Set while the thread places an allocation, whose own allocations are not counted
+static NameList 		GInclude;						//!< Symbols of the request path
+static NameList 		GExclude;						//!< Symbols whose allocations are not counted
+
+
+
+/**
+ * @fn splitNames
+ * @param List to be filled
+ * @param Value of the environment variable, NULL if not set
+ * @param Value used when the variable is not set
+ * @ret void
+ */
+static void splitNames(NameList &pList, const char *pValue, const char *pDefault)
+{
+	char 	*lpName;	//!< Name being added
+
+	snprintf(pList.buffer, sizeof(pList.buffer), "%s", (NULL == pValue) ? pDefault : pValue);
+	pList.count = 0;
+	for (lpName = strtok(pList.buffer, ","); NULL != lpName && pList.count < ALLOC_MAX_NAMES; lpName = strtok(NULL, ","))
+	{
+		pList.names[pList.count++] = lpName;
+	}
+}
+
+
+
+/**
+ * @fn hasName
+ * @param Symbol of a frame
+ * @param Names looked for
+ * @ret returns true if the symbol contains one of the names
+ */
+static bool hasName(const char *pSymbol, const NameList &pList)
+{
+	int 	lIndex;		//!< Used as index in loops
+
+	for (lIndex = 0; NULL != pSymbol && lIndex < pList.count; lIndex++)
+	{
+		if (NULL != strstr(pSymbol, pList.names[lIndex]))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+/**
+ * @fn isRequestPath
+ * @param Nil
+ * @ret returns true if the allocation being made is on the request path and not excluded
+ */
+static bool isRequestPath()
+{
+	void 	*lFrames[ALLOC_STACK_DEPTH];		//!< Return addresses on the stack
+	Dl_info lInfo;							//!< Symbol of a frame
+	bool 	lIsIncluded = (0 == GInclude.count);
+	int 	lCount;							//!< Number of frames
+	int 	lIndex;							//!< Used as index in loops
+
+	lCount = backtrace(lFrames, ALLOC_STACK_DEPTH);
+	for (lIndex = 0; lIndex < lCount; lIndex++)
+	{
+		if (0 == dladdr(lFrames[lIndex], &lInfo))
+		{
+			continue;
+		}
+		if (hasName(lInfo.dli_sname, GExclude))
+		{
+			return false;
+		}
+		lIsIncluded = lIsIncluded || hasName(lInfo.dli_sname, GInclude);
+	}
+	return lIsIncluded;
+}
+
+
+
+/**
+ * @fn countAlloc
+ * @param Bytes requested
+ * @ret void
+ * @brief Adds the allocation to the slot of the thread. Only the thread writes its slot, so no lock is needed
+ */
+static void countAlloc(size_t pSize)
+{
+	if (GSlot < 0)
+	{
+		GSlot = __sync_fetch_and_add(&GSlotCount, 1);
+		GSlot = (GSlot < ALLOC_COUNT_THREADS) ? GSlot : ALLOC_COUNT_THREADS - 1;
+		GSlots[GSlot].threadId = syscall(SYS_gettid);
+	}
+	GSlots[GSlot].count++;
+	GSlots[GSlot].bytes += pSize;
+
+	if (GIsInWindow && !GIsInHook)
+	{
+		GIsInHook = 1;
+		if (isRequestPath())
+		{
+			GSlots[GSlot].windowCount++;
+		}
+		GIsInHook = 0;
+	}
+}
+
+
+
+/**
+ * @fn writeCounts
+ * @param Nil
+ * @ret void
+ * @brief Writes one line <thread id> <allocations> <bytes> per thread. Uses only write, so that the dump itself does not allocate
+ */
+static void writeCounts()
+{
+	char 	lLine[128];		//!< Line of a thread
+	int 	lFd;			//!< Count file
+	int 	lCount;			//!< Number of slots taken
+	int 	lIndex;			//!< Used as index in loops
+
+	lFd = open(GFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (lFd < 0)
+	{
+		return;
+	}
+	lCount = (GSlotCount < ALLOC_COUNT_THREADS) ? GSlotCount : ALLOC_COUNT_THREADS;
+	for (lIndex = 0; lIndex < lCount; lIndex++)
+	{
+		snprintf(lLine, sizeof(lLine), "%ld %llu %llu\n", GSlots[lIndex].threadId, GSlots[lIndex].count, GSlots[lIndex].bytes);
+		write(lFd, lLine, strlen(lLine));
+	}
+	close(lFd);
+}
+
+
+
+/**
+ * @fn writeResult
+ * @param Nil
+ * @ret void
+ * @brief Writes the request path allocations of the window, one line <thread id> <allocations> per thread, then PASS or FAIL <total>
+ */
+static void writeResult()
+{
+	char 				lLine[128];			//!< Line of a thread
+	unsigned long long 	lTotal = 0;			//!< Allocations of all the threads
+	int 				lFd;				//!< Result file
+	int 				lCount;				//!< Number of slots taken
+	int 				lIndex;				//!< Used as index in loops
+
+	lFd = open(GResultFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (lFd < 0)
+	{
+		return;
+	}
+	lCount = (GSlotCount < ALLOC_COUNT_THREADS) ? GSlotCount : ALLOC_COUNT_THREADS;
+	for (lIndex = 0; lIndex < lCount; lIndex++)
+	{
+		if (0 != GSlots[lIndex].windowCount)
+		{
+			snprintf(lLine, sizeof(lLine), "%ld %llu\n", GSlots[lIndex].threadId, GSlots[lIndex].windowCount);
+			write(lFd, lLine, strlen(lLine));
+			lTotal += GSlots[lIndex].windowCount;
+		}
+	}
+	if (0 == lTotal)
+	{
+		snprintf(lLine, sizeof(lLine), "PASS\n");
+	}
+	else
+	{
+		snprintf(lLine, sizeof(lLine), "FAIL %llu\n", lTotal);
+	}
+	write(lFd, lLine, strlen(lLine));
+	close(lFd);
+}
+
+
+
+/**
+ * @fn writerThread
+ * @param Seconds between the dumps
+ * @ret NULL
+ * @brief Opens and closes the measured window as the window file appears and goes, and dumps the counts every interval
+ */
+static void* writerThread(void *pArg)
+{
+	long 		lInterval = (long) pArg;
+	long 		lElapsed = 0;		//!< Milliseconds since the last dump
+	struct stat lFileInfo;			//!< Status of the window file
+	bool 		lIsOpen;			//!< Set if the window file is present
+	int 		lIndex;				//!< Used as index in loops
+
+	while (true)
+	{
+		usleep(ALLOC_POLL_INTERVAL * 1000);
+
+		lIsOpen = (0 == stat(GWindowFile, &lFileInfo));
+		if (lIsOpen && !GIsInWindow)
+		{
+			for (lIndex = 0; lIndex < ALLOC_COUNT_THREADS; lIndex++)
+			{
+				GSlots[lIndex].windowCount = 0;
+			}
+			__sync_synchronize();
+			GIsInWindow = 1;
+		}
+		else if (!lIsOpen && GIsInWindow)
+		{
+			GIsInWindow = 0;
+			__sync_synchronize();
+			writeResult();
+		}
+
+		lElapsed += ALLOC_POLL_INTERVAL;
+		if (lElapsed >= lInterval * 1000)
+		{
+			writeCounts();
+			lElapsed = 0;
+		}
+	}
+	return NULL;
+}
+
+
+
+/**
+ * @fn startCounter
+ * @param Nil
+ * @ret void
+ * @brief Runs when the library is loaded, before the main of the Session Layer
+ */
+__attribute__((constructor)) static void startCounter()
+{
+	pthread_t 	lThreadId;		//!< Writer thread
+	long 		lInterval;		//!< Seconds between the dumps
+
+	if (NULL != getenv("ALLOC_COUNT_FILE"))
+	{
+		snprintf(GFileName, sizeof(GFileName), "%s", getenv("ALLOC_COUNT_FILE"));
+	}
+	else
+	{
+		snprintf(GFileName, sizeof(GFileName), "/tmp/AllocCount.%d", (int) getpid());
+	}
+	lInterval = (NULL == getenv("ALLOC_COUNT_INTERVAL")) ? 10 : atol(getenv("ALLOC_COUNT_INTERVAL"));
+	lInterval = (lInterval < 1) ? 1 : lInterval;
+	snprintf(GWindowFile, sizeof(GWindowFile), "%s.window", GFileName);
+	snprintf(GResultFile, sizeof(GResultFile), "%s.result", GFileName);
+	splitNames(GInclude, getenv("ALLOC_COUNT_INCLUDE"), "XMLIAClient12startProcess");
+	splitNames(GExclude, getenv("ALLOC_COUNT_EXCLUDE"), "ABL_Logger");
+
+	//! The first backtrace loads the unwinder, which allocates, so it is done here rather than within the window
+	GIsInHook = 1;
+	isRequestPath();
+	GIsInHook = 0;
+
+	atexit(writeCounts);
+	if (0 == pthread_create(&lThreadId, NULL, writerThread, (void*) lInterval))
+	{
+		pthread_detach(lThreadId);
+	}
+}
+
+
+
+extern "C"
+{
+	void* malloc(size_t pSize)
+	{
+		countAlloc(pSize);
+		return __libc_malloc(pSize);
+	}
+
+	void* calloc(size_t pCount, size_t pSize)
+	{
+		countAlloc(pCount * pSize);
+		return __libc_calloc(pCount, pSize);
+	}
+
+	void* realloc(void *pPtr, size_t pSize)
+	{
+		countAlloc(pSize);
+		return __libc_realloc(pPtr, pSize);
+	}
+
+	void* memalign(size_t pAlignment, size_t pSize)
+	{
+		countAlloc(pSize);
+		return __libc_memalign(pAlignment, pSize);
+	}
+
+	int posix_memalign(void **pPtr, size_t pAlignment, size_t pSize)
+	{
+		countAlloc(pSize);
+		*pPtr = __libc_memalign(pAlignment, pSize);
+		return (NULL == *pPtr) ? ENOMEM : 0;
+	}
+}
@@ -0,0 +1,100 @@
+/**
+    @file FlightTrace.cpp
+    @brief Converts the flight recorder dump of the Session Layer to the Chrome trace JSON format
+
+	Usage : FlightTrace <dump file> > trace.json
+	Each event of a thread is written as a complete event lasting till the next event of the same thread. The output can be opened in
+	chrome://tracing or in Perfetto.
+*/
+
+#include <FlightRecorder.h>
+#include <stdio.h>
+#include <vector>
+
+using namespace SPS;
+
+//! Names of the stages. The order should match the FlightStage enumeration
+static const char *GStageNames[FR_MAX_STAGE] =
+{
+	"GetMessage",
+	"Dispatch",
+	"sendBytes",
+	"recvResponse",
+	"PushMessage",
+	"Connect",
+	"Login",
+	"Logout",
+	"Exit"
+};
+
+
+
+/**
+ * @fn main
+ * @param Integer indicating the number of arguments passed from command line
+ * @param Pointer to a character array which stores all the arguments passed to the main
+ * @brief Reads the dump file and writes the trace JSON to the standard output
+ */
+int main(int argc, char* argv[])
+{
+	FILE 					*lpFile;			//!< Dump file
+	FlightFileHeader 		lFileHeader;		//!< Header of the dump file
+	FlightRingHeader 		lRingHeader;		//!< Header of each ring
+	std::vector<FlightEvent> 	lEvents;			//!< Events of the ring being converted
+	unsigned int 			lRing;				//!< Used as index in loops
+	unsigned int 			lIndex;				//!< Used as index in loops
+	bool 					lIsFirst = true;	//!< Set till the first trace event is written
+
+	if (2 != argc)
+	{
+		fprintf(stderr, "Usage : %s <flight recorder dump file>\n", argv[0]);
+		return -1;
+	}
+
+	lpFile = fopen(argv[1], "rb");
+	if (NULL == lpFile)
+	{
+		fprintf(stderr, "Unable to open %s\n", argv[1]);
+		return -1;
+	}
+
+	if (1 != fread(&lFileHeader, sizeof(lFileHeader), 1, lpFile) || FLIGHT_FILE_MAGIC != lFileHeader.magic
+		|| FLIGHT_FILE_VERSION != lFileHeader.version || sizeof(FlightEvent) != lFileHeader.eventSize)
+	{
+		fprintf(stderr, "%s is not a flight recorder dump of this version\n", argv[1]);
+		fclose(lpFile);
+		return -1;
+	}
+
+	printf("{\"traceEvents\":[\n");
+	for (lRing = 0; lRing < lFileHeader.ringCount; lRing++)
+	{
+		if (1 != fread(&lRingHeader, sizeof(lRingHeader), 1, lpFile))
+		{
+			break;
+		}
+
+		lEvents.resize(lRingHeader.eventCount);
+		if (0 != lRingHeader.eventCount && lRingHeader.eventCount != fread(&lEvents[0], sizeof(FlightEvent), lRingHeader.eventCount, lpFile))
+		{
+			break;
+		}
+
+		//! The last event of the ring has no end and is not written
+		for (lIndex = 0; lIndex + 1 < lEvents.size(); lIndex++)
+		{
+			if (lEvents[lIndex].stage >= FR_EXIT)
+			{
+				continue;
+			}
+			printf("%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"mType\":%lld}}",
+				lIsFirst ? "" : ",\n", GStageNames[lEvents[lIndex].stage], lRingHeader.threadId,
+				lEvents[lIndex].timestamp / 1000.0, (lEvents[lIndex + 1].timestamp - lEvents[lIndex].timestamp) / 1000.0, lEvents[lIndex].mType);
+			lIsFirst = false;
+		}
+	}
+	printf("\n]}\n");
+
+	fclose(lpFile);
+	return 0;
+}//int main(int argc, char* argv[])
@@ -0,0 +1,525 @@
+/**
+    @file TrafficReplay.cpp
+    @brief Replays the traffic captured by the Session Layer and acts as a stand-in SPS answering with the captured responses
+
+	Usage : TrafficReplay sps <capture file> <port>
+				Listens on the port and answers every request found in the capture with its captured response. Login and logout are
+				always successful. Point the SPS server of a test Session Layer to this port.
+			TrafficReplay replay <capture file> <speed> <user>=<request queue key>:<response queue key>[:<shards>[:<key stride>]] ...
+				Pushes the captured requests into the Request Message Queues of the users, keeping the captured gaps divided by the
+				speed, reads the responses back and compares them with the captured responses. As with QueueShards, the request of
+				mType goes to the request shard mType % N and its response is read from the response shard mType % N, shard i using
+				the keys plus i * stride (QueueShardKeyStride, 65536 by default). Without the shard count, the shards are found by
+				looking up the keys of the next shard till one is missing. The latency percentiles printed at
+				the end compare the p99 of two runs, e.g. with and without CpuSet configured for the users.
+*/
+
+#include <TrafficCapture.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <zlib.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace SPS;
+
+#define REPLAY_DRAIN_TIMEOUT 	30		//!< Seconds to wait for the responses after the last request is pushed
+#define REPLAY_KEY_STRIDE 		0x10000	//!< Default distance between the queue keys of two shards, as QueueShardKeyStride
+#define REPLAY_MAX_SHARDS 		256		//!< Maximum number of shards looked up when the shard count is not given
+
+//! A captured message along with the captured response when it is a request
+struct CapturedMessage
+{
+	CaptureRecord 	record;			//!< Record read from the capture file
+	std::string 	payload;		//!< Payload of the message
+	int 			response;		//!< Index of the captured response of a request, -1 if none
+};
+
+//! Layout of the messages in the System V queues
+struct QueueMessage
+{
+	long 	mType;
+	char 	xmlRequest[4096];
+};
+
+//! A request pushed by the replay and waiting for its response
+struct PendingRequest
+{
+	int 		message;		//!< Index of the request in the capture
+	long long 	sentTime;		//!< Time in epoch microseconds at which it was pushed
+};
+
+//! Queues of a user and the requests waiting for the response
+struct ReplayUser
+{
+	std::string 		userName;
+	std::vector<int> 	requestQueueIds;	//!< Request Message Queue of each shard
+	std::vector<int> 	responseQueueIds;	//!< Response Message Queue of each shard
+	std::vector<pthread_t> 	threadIds;		//!< Thread reading each Response Message Queue
+	std::map<long, std::deque<PendingRequest> > 	pending;
+};
+
+//! Response Message Queue read by a thread
+struct ResponseReader
+{
+	ReplayUser 	*user;
+	int 		queueId;
+};
+
+static std::vector<CapturedMessage> 	GMessages;							//!< All the messages of the capture
+static std::map<std::string, std::string> 	GAnswers;					//!< Captured response of each request, used by the stand-in SPS
+static pthread_mutex_t 				GMutex = PTHREAD_MUTEX_INITIALIZER;	//!< Protects the pending requests and the totals
+static long 						GSent, GMatched, GMismatched, GUnexpected;
+static long long 					GTotalLatency, GMaxLatency;
+static std::vector<long long> 		GLatencies;							//!< Latency of every answered request, for the percentiles
+
+
+
+/**
+ * @fn nowMicros
+ * @param Nil
+ * @ret returns the current time in epoch microseconds
+ */
+static long long nowMicros()
+{
+	struct timeval 	lNow;
+
+	gettimeofday(&lNow, NULL);
+	return (long long) lNow.tv_sec * 1000000 + lNow.tv_usec;
+}
+
+
+
+/**
+ * @fn loadCapture
+ * @param Name of the capture file
+ * @ret returns 0 on success and -1 on failure
+ * @brief Reads all the messages and pairs each request with the next response of the same user and mType
+ */
+static int loadCapture(const char *pFileName)
+{
+	gzFile 				lFile;			//!< Capture file
+	CaptureFileHeader 	lHeader;		//!< Header of the capture file
+	CapturedMessage 	lMessage;		//!< Message being read
+	std::vector<char> 	lBuffer;		//!< Buffer for the payload
+	int 				lIndex;			//!< Used as index in loops
+	std::map<std::string, std::deque<int> > 	lOpen;	//!< Requests without response for each user and mType
+
+	lFile = gzopen(pFileName, "rb");
+	if (NULL == lFile)
+	{
+		fprintf(stderr, "Unable to open %s\n", pFileName);
+		return -1;
+	}
+
+	if (sizeof(lHeader) != gzread(lFile, &lHeader, sizeof(lHeader)) || CAPTURE_FILE_MAGIC != lHeader.magic || CAPTURE_FILE_VERSION != lHeader.version)
+	{
+		fprintf(stderr, "%s is not a traffic capture of this version\n", pFileName);
+		gzclose(lFile);
+		return -1;
+	}
+
+	while (sizeof(lMessage.record) == gzread(lFile, &lMessage.record, sizeof(lMessage.record)))
+	{
+		lBuffer.resize(lMessage.record.length + 1);
+		if ((int) lMessage.record.length != gzread(lFile, &lBuffer[0], lMessage.record.length))
+		{
+			break;
+		}
+		lMessage.payload.assign(&lBuffer[0], lMessage.record.length);
+		lMessage.response = -1;
+		GMessages.push_back(lMessage);
+	}
+	gzclose(lFile);
+
+	for (lIndex = 0; lIndex < (int) GMessages.size(); lIndex++)
+	{
+		char 	lKey[64];
+
+		snprintf(lKey, sizeof(lKey), "%s/%lld", GMessages[lIndex].record.userName, GMessages[lIndex].record.mType);
+		std::deque<int> &lQueue = lOpen[lKey];
+
+		if (CAPTURE_REQUEST == GMessages[lIndex].record.kind)
+		{
+			lQueue.push_back(lIndex);
+		}
+		else if (!lQueue.empty())
+		{
+			GMessages[lQueue.front()].response = lIndex;
+			lQueue.pop_front();
+		}
+	}
+
+	fprintf(stderr, "Loaded %d messages from %s\n", (int) GMessages.size(), pFileName);
+	return 0;
+}//static int loadCapture(const char *pFileName)
+
+
+
+/**
+ * @fn unwrapResponse
+ * @param Response in the serialized form s:<len>:"<response>";
+ * @ret returns the response as sent by SPS
+ */
+static std::string unwrapResponse(const std::string &pResponse)
+{
+	size_t 	lStart = pResponse.find('"');
+
+	if (std::string::npos == lStart || pResponse.size() < lStart + 3)
+	{
+		return pResponse;
+	}
+	return pResponse.substr(lStart + 1, pResponse.size() - lStart - 3);
+}
+
+
+
+/**
+ * @fn serveConnection
+ * @param Pointer to the descriptor of the accepted socket
+ * @ret NULL
+ * @brief Thread answering the requests of one Session Layer connection
+ */
+static void* serveConnection(void *pArg)
+{
+	int 			lSocketDesc = *(int*) pArg;			//!< Accepted socket
+	char 			lRequest[4096];						//!< Request from the Session Layer
+	int 			lLength;							//!< Length of the request
+	std::string 	lResponse;							//!< Response to be sent
+
+	free(pArg);
+
+	while (0 < (lLength = recv(lSocketDesc, lRequest, sizeof(lRequest) - 1, 0)))
+	{
+		lRequest[lLength] = '\0';
+		if (NULL != strstr(lRequest, "<Login"))
+		{
+			lResponse = "<Response>Login Successful</Response>";
+		}
+		else if (NULL != strstr(lRequest, "<Logout"))
+		{
+			lResponse = "<Response>Logout Successful</Response>";
+		}
+		else if (GAnswers.end() != GAnswers.find(lRequest))
+		{
+			lResponse = GAnswers[lRequest];
+		}
+		else
+		{
+			lResponse = "<Error>Request not present in the capture</Error>";
+		}
+		send(lSocketDesc, lResponse.c_str(), lResponse.size(), 0);
+	}
+
+	close(lSocketDesc);
+	return NULL;
+}//static void* serveConnection(void *pArg)
+
+
+
+/**
+ * @fn runStandInSPS
+ * @param Port on which the connections are accepted
+ * @ret returns -1 on failure, never returns otherwise
+ */
+static int runStandInSPS(int pPort)
+{
+	struct sockaddr_in 	lAddress;						//!< Address on which the connections are accepted
+	int 				lListenDesc;					//!< Listening socket
+	int 				lSocketDesc;					//!< Accepted socket
+	int 				lOn = 1;
+	int 				*lpArg;							//!< Argument of the connection thread
+	pthread_t 			lThread;
+	int 				lIndex;
+
+	for (lIndex = 0; lIndex < (int) GMessages.size(); lIndex++)
+	{
+		if (CAPTURE_REQUEST == GMessages[lIndex].record.kind && 0 <= GMessages[lIndex].response)
+		{
+			GAnswers[GMessages[lIndex].payload] = unwrapResponse(GMessages[GMessages[lIndex].response].payload);
+		}
+	}
+
+	lListenDesc = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(lListenDesc, SOL_SOCKET, SO_REUSEADDR, &lOn, sizeof(lOn));
+	memset(&lAddress, 0, sizeof(lAddress));
+	lAddress.sin_family = AF_INET;
+	lAddress.sin_port = htons(pPort);
+	lAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (0 != bind(lListenDesc, (struct sockaddr*) &lAddress, sizeof(lAddress)) || 0 != listen(lListenDesc, 64))
+	{
+		fprintf(stderr, "Unable to listen on port %d : %s\n", pPort, strerror(errno));
+		return -1;
+	}
+	fprintf(stderr, "Stand-in SPS listening on port %d with %d captured responses\n", pPort, (int) GAnswers.size());
+
+	while (0 <= (lSocketDesc = accept(lListenDesc, NULL, NULL)))
+	{
+		lpArg = (int*) malloc(sizeof(int));
+		*lpArg = lSocketDesc;
+		pthread_create(&lThread, NULL, serveConnection, lpArg);
+		pthread_detach(lThread);
+	}
+	return -1;
+}//static int runStandInSPS(int pPort)
+
+
+
+/**
+ * @fn readResponses
+ * @param Pointer to the ResponseReader
+ * @ret NULL
+ * @brief Thread reading a Response Message Queue of a user and comparing each response with the captured one
+ */
+static void* readResponses(void *pArg)
+{
+	ResponseReader 	*lpReader = (ResponseReader*) pArg;
+	ReplayUser 		*lpUser = lpReader->user;
+	QueueMessage 	lMessage;
+	PendingRequest 	lRequest;
+	long long 		lLatency;
+	int 			lExpected;
+
+	while (0 <= msgrcv(lpReader->queueId, &lMessage, sizeof(lMessage.xmlRequest), 0, 0))
+	{
+		pthread_mutex_lock(&GMutex);
+		std::deque<PendingRequest> &lPending = lpUser->pending[lMessage.mType];
+		if (lPending.empty())
+		{
+			GUnexpected++;
+			pthread_mutex_unlock(&GMutex);
+			continue;
+		}
+		lRequest = lPending.front();
+		lPending.pop_front();
+
+		lLatency = nowMicros() - lRequest.sentTime;
+		GTotalLatency += lLatency;
+		GMaxLatency = (lLatency > GMaxLatency) ? lLatency : GMaxLatency;
+		GLatencies.push_back(lLatency);
+
+		lExpected = GMessages[lRequest.message].response;
+		if (0 <= lExpected && GMessages[lExpected].payload == lMessage.xmlRequest)
+		{
+			GMatched++;
+		}
+		else
+		{
+			GMismatched++;
+			fprintf(stderr, "Mismatch for User : %s | mType : %ld | Received : %.200s\n", lpUser->userName.c_str(), lMessage.mType, lMessage.xmlRequest);
+		}
+		pthread_mutex_unlock(&GMutex);
+	}
+	return NULL;
+}//static void* readResponses(void *pArg)
+
+
+
+/**
+ * @fn runReplay
+ * @param Replay speed, 2 replays twice as fast as captured
+ * @param Users with their queues
+ * @ret returns 0 if all the responses matched and 1 otherwise
+ */
+static int runReplay(double pSpeed, std::map<std::string, ReplayUser*> &pUsers)
+{
+	std::map<std::string, ReplayUser*>::iterator 	lIter;
+	QueueMessage 	lMessage;
+	PendingRequest 	lRequest;
+	ReplayUser 		*lpUser;
+	long long 		lFirstCaptured = -1;	//!< Capture time of the first request
+	long long 		lStart;					//!< Replay start time
+	long long 		lDue;					//!< Time at which the request is due
+	ResponseReader 	*lpReader;
+	long 			lOutstanding;
+	int 			lIndex;
+	int 			lWait;
+
+	for (lIter = pUsers.begin(); lIter != pUsers.end(); lIter++)
+	{
+		lIter->second->threadIds.resize(lIter->second->responseQueueIds.size());
+		for (lIndex = 0; lIndex < (int) lIter->second->responseQueueIds.size(); lIndex++)
+		{
+			lpReader = new ResponseReader;
+			lpReader->user = lIter->second;
+			lpReader->queueId = lIter->second->responseQueueIds[lIndex];
+			pthread_create(&lIter->second->threadIds[lIndex], NULL, readResponses, lpReader);
+		}
+	}
+
+	lStart = nowMicros();
+	for (lIndex = 0; lIndex < (int) GMessages.size(); lIndex++)
+	{
+		CaptureRecord &lRecord = GMessages[lIndex].record;
+
+		if (CAPTURE_REQUEST != lRecord.kind || pUsers.end() == (lIter = pUsers.find(lRecord.userName)))
+		{
+			continue;
+		}
+		lpUser = lIter->second;
+
+		if (lFirstCaptured < 0)
+		{
+			lFirstCaptured = lRecord.timestamp;
+		}
+		lDue = lStart + (long long) ((lRecord.timestamp - lFirstCaptured) / pSpeed);
+		if (lDue > nowMicros())
+		{
+			usleep(lDue - nowMicros());
+		}
+
+		memset(&lMessage, 0, sizeof(lMessage));
+		lMessage.mType = lRecord.mType;
+		strncpy(lMessage.xmlRequest, GMessages[lIndex].payload.c_str(), sizeof(lMessage.xmlRequest) - 1);
+
+		pthread_mutex_lock(&GMutex);
+		lRequest.message = lIndex;
+		lRequest.sentTime = nowMicros();
+		lpUser->pending[lMessage.mType].push_back(lRequest);
+		GSent++;
+		pthread_mutex_unlock(&GMutex);
+
+		msgsnd(lpUser->requestQueueIds[lMessage.mType % lpUser->requestQueueIds.size()], &lMessage, sizeof(lMessage.xmlRequest), 0);
+	}
+
+	//! Waiting for the outstanding responses
+	for (lWait = 0; lWait < REPLAY_DRAIN_TIMEOUT; lWait++)
+	{
+		pthread_mutex_lock(&GMutex);
+		lOutstanding = GSent - GMatched - GMismatched;
+		pthread_mutex_unlock(&GMutex);
+		if (0 == lOutstanding)
+		{
+			break;
+		}
+		sleep(1);
+	}
+
+	pthread_mutex_lock(&GMutex);
+	std::sort(GLatencies.begin(), GLatencies.end());
+	printf("Sent : %ld | Matched : %ld | Mismatched : %ld | Unanswered : %ld | Unexpected : %ld | Avg Latency : %lld us | Max Latency : %lld us | Duration : %lld ms\n",
+		GSent, GMatched, GMismatched, GSent - GMatched - GMismatched, GUnexpected,
+		(0 == GMatched + GMismatched) ? 0 : GTotalLatency / (GMatched + GMismatched), GMaxLatency, (nowMicros() - lStart) / 1000);
+	printf("p50 Latency : %lld us | p99 Latency : %lld us | p99.9 Latency : %lld us\n",
+		GLatencies.empty() ? 0 : GLatencies[GLatencies.size() * 50 / 100],
+		GLatencies.empty() ? 0 : GLatencies[GLatencies.size() * 99 / 100],
+		GLatencies.empty() ? 0 : GLatencies[GLatencies.size() * 999 / 1000]);
+	lOutstanding = GSent - GMatched;
+	pthread_mutex_unlock(&GMutex);
+
+	return (0 == lOutstanding) ? 0 : 1;
+}//static int runReplay(double pSpeed, std::map<std::string, ReplayUser*> &pUsers)
+
+
+
+/**
+ * @fn openQueues
+ * @param User whose queues are looked up
+ * @param Queue specification <request queue key>:<response queue key>[:<shards>[:<key stride>]]
+ * @ret returns 0 on success and -1 if a queue is not present
+ */
+static int openQueues(ReplayUser *pUser, const char *pSpec)
+{
+	char 	*lpNext;			//!< Rest of the specification
+	key_t 	lRequestKey;		//!< Request queue key of shard 0
+	key_t 	lResponseKey;		//!< Response queue key of shard 0
+	long 	lShardCount = 0;	//!< Number of shards, 0 to look them up
+	long 	lStride = REPLAY_KEY_STRIDE;
+	int 	lRequestId;
+	int 	lResponseId;
+	int 	lIndex;
+
+	lRequestKey = (key_t) strtol(pSpec, &lpNext, 0);
+	lResponseKey = (key_t) strtol(lpNext + 1, &lpNext, 0);
+	if (':' == *lpNext)
+	{
+		lShardCount = strtol(lpNext + 1, &lpNext, 0);
+	}
+	if (':' == *lpNext)
+	{
+		lStride = strtol(lpNext + 1, &lpNext, 0);
+	}
+
+	for (lIndex = 0; (0 == lShardCount) ? lIndex < REPLAY_MAX_SHARDS : lIndex < lShardCount; lIndex++)
+	{
+		lRequestId = msgget(lRequestKey + lIndex * lStride, 0666);
+		lResponseId = msgget(lResponseKey + lIndex * lStride, 0666);
+		if (lRequestId < 0 || lResponseId < 0)
+		{
+			if (0 == lShardCount && 0 < lIndex)
+			{
+				break;
+			}
+			return -1;
+		}
+		pUser->requestQueueIds.push_back(lRequestId);
+		pUser->responseQueueIds.push_back(lResponseId);
+	}
+	return 0;
+}//static int openQueues(ReplayUser *pUser, const char *pSpec)
+
+
+
+/**
+ * @fn main
+ * @param Integer indicating the number of arguments passed from command line
+ * @param Pointer to a character array which stores all the arguments passed to the main
+ */
+int main(int argc, char* argv[])
+{
+	std::map<std::string, ReplayUser*> 	lUsers;
+	ReplayUser 		*lpUser;
+	char 			*lpKeys;
+	int 			lIndex;
+
+	if (4 == argc && 0 == strcmp(argv[1], "sps"))
+	{
+		return (0 == loadCapture(argv[2])) ? runStandInSPS(atoi(argv[3])) : -1;
+	}
+
+	if (5 > argc || 0 != strcmp(argv[1], "replay") || 0 >= atof(argv[3]))
+	{
+		fprintf(stderr, "Usage : %s sps <capture file> <port>\n", argv[0]);
+		fprintf(stderr, "        %s replay <capture file> <speed> <user>=<request queue key>:<response queue key>[:<shards>[:<key stride>]] ...\n", argv[0]);
+		return -1;
+	}
+
+	for (lIndex = 4; lIndex < argc; lIndex++)
+	{
+		lpKeys = strchr(argv[lIndex], '=');
+		if (NULL == lpKeys || NULL == strchr(lpKeys, ':'))
+		{
+			fprintf(stderr, "Invalid user queue specification : %s\n", argv[lIndex]);
+			return -1;
+		}
+
+		lpUser = new ReplayUser;
+		lpUser->userName.assign(argv[lIndex], lpKeys - argv[lIndex]);
+		if (0 != openQueues(lpUser, lpKeys + 1))
+		{
+			fprintf(stderr, "Message queues of %s are not present. Start the Session Layer first\n", lpUser->userName.c_str());
+			return -1;
+		}
+		printf("User : %s | Queue Shards : %d\n", lpUser->userName.c_str(), (int) lpUser->requestQueueIds.size());
+		lUsers[lpUser->userName] = lpUser;
+	}
+
+	if (0 != loadCapture(argv[2]))
+	{
+		return -1;
+	}
+	return runReplay(atof(argv[3]), lUsers);
+}//int main(int argc, char* argv[])
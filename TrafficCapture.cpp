@@ -0,0 +1,187 @@
+/**
+    @file TrafficCapture.cpp
+    @brief This file contains the definition for all the member functions of the TrafficCapture class
+
+*/
+
+#include <TrafficCapture.h>
+#include <SessionStats.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <zlib.h>
+
+using namespace SPS;
+
+pthread_mutex_t 	TrafficCapture::_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t 		TrafficCapture::_cond = PTHREAD_COND_INITIALIZER;
+pthread_t 			TrafficCapture::_writerId;
+void 				*TrafficCapture::_file = NULL;
+char 				*TrafficCapture::_buffer = NULL;
+char 				*TrafficCapture::_spare = NULL;
+size_t 				TrafficCapture::_size = 0;
+size_t 				TrafficCapture::_used = 0;
+bool 				TrafficCapture::_isClosing = false;
+
+
+
+/**
+ * @fn Open
+ * @param Name of the capture file
+ * @param Size in KB of the buffer to which the messages are copied
+ * @ret returns 0 on success and -1 on failure
+ * @brief Creates the capture file, writes its header and starts the writer thread. Should be invoked before the XMLIAClient threads
+		are started
+ */
+int TrafficCapture::Open(const char *pFileName, int pBufferSize)
+{
+	CaptureFileHeader 	lHeader;	//!< Header of the capture file
+	gzFile 				lFile;		//!< Capture file
+
+	_size = (pBufferSize < 64) ? 64 * 1024 : (size_t) pBufferSize * 1024;
+	_buffer = (char*) malloc(_size);
+	_spare = (char*) malloc(_size);
+	lFile = gzopen(pFileName, "wb6");
+	if (NULL == _buffer || NULL == _spare || NULL == lFile)
+	{
+		free(_buffer);
+		free(_spare);
+		_buffer = _spare = NULL;
+		if (NULL != lFile)
+		{
+			gzclose(lFile);
+		}
+		return -1;
+	}
+
+	lHeader.magic = CAPTURE_FILE_MAGIC;
+	lHeader.version = CAPTURE_FILE_VERSION;
+	gzwrite(lFile, &lHeader, sizeof(lHeader));
+
+	_file = lFile;
+	if (0 != pthread_create(&_writerId, NULL, writerThread, NULL))
+	{
+		_file = NULL;
+		gzclose(lFile);
+		return -1;
+	}
+	return 0;
+}//int TrafficCapture::Open(const char *pFileName, int pBufferSize)
+
+
+
+/**
+ * @fn Record
+ * @param Direction of the message
+ * @param User to which the message belongs
+ * @param mType of the message
+ * @param Payload of the message
+ * @ret void
+ * @brief Copies the message to the buffer of the writer thread
+ */
+void TrafficCapture::Record(CaptureKind pKind, const char *pUserName, long pMType, const char *pPayload)
+{
+	CaptureRecord 	lRecord;	//!< Record written ahead of the payload
+	struct timeval 	lNow;		//!< Current time
+
+	if (NULL == _file)
+	{
+		return;
+	}
+
+	gettimeofday(&lNow, NULL);
+	memset(&lRecord, 0, sizeof(lRecord));
+	lRecord.timestamp = (long long) lNow.tv_sec * 1000000 + lNow.tv_usec;
+	lRecord.mType = pMType;
+	lRecord.kind = pKind;
+	lRecord.length = strlen(pPayload);
+	strncpy(lRecord.userName, pUserName, CAPTURE_USER_LENGTH - 1);
+
+	pthread_mutex_lock(&_mutex);
+	if (_isClosing || _used + sizeof(lRecord) + lRecord.length > _size)
+	{
+		SessionStats::Increment(DROPPED_CAPTURES);
+	}
+	else
+	{
+		memcpy(_buffer + _used, &lRecord, sizeof(lRecord));
+		memcpy(_buffer + _used + sizeof(lRecord), pPayload, lRecord.length);
+		_used += sizeof(lRecord) + lRecord.length;
+		if (_used > _size / 2)
+		{
+			pthread_cond_signal(&_cond);
+		}
+	}
+	pthread_mutex_unlock(&_mutex);
+}//void TrafficCapture::Record(...)
+
+
+
+/**
+ * @fn writerThread
+ * @param Nil
+ * @ret NULL
+ * @brief Swaps out the buffer once it is half full, or every second, and compresses it to the file outside the lock. Flushes the
+		buffer and closes the file once Close is invoked
+ */
+void* TrafficCapture::writerThread(void *pArg)
+{
+	struct timespec 	lWakeTime;		//!< Time till which the writer waits for the buffer to fill
+	char 				*lpFull;		//!< Buffer swapped out for writing
+	size_t 				lLength;		//!< Bytes in the buffer swapped out
+	bool 				lIsClosing;		//!< Set once Close is invoked
+
+	do
+	{
+		pthread_mutex_lock(&_mutex);
+		if (!_isClosing && _used <= _size / 2)
+		{
+			clock_gettime(CLOCK_REALTIME, &lWakeTime);
+			lWakeTime.tv_sec += 1;
+			pthread_cond_timedwait(&_cond, &_mutex, &lWakeTime);
+		}
+		lpFull = _buffer;
+		_buffer = _spare;
+		_spare = lpFull;
+		lLength = _used;
+		_used = 0;
+		lIsClosing = _isClosing;
+		pthread_mutex_unlock(&_mutex);
+
+		if (0 < lLength)
+		{
+			gzwrite((gzFile) _file, lpFull, lLength);
+		}
+	} while (!lIsClosing);
+
+	gzclose((gzFile) _file);
+	return NULL;
+}//void* TrafficCapture::writerThread(void *pArg)
+
+
+
+/**
+ * @fn Close
+ * @param Nil
+ * @ret void
+ * @brief Makes the writer thread flush the buffer and close the capture file, and waits for it. Invoked on the shut down of the
+		Session Layer from the main path, never from a signal handler
+ */
+void TrafficCapture::Close()
+{
+	if (NULL == _file)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&_mutex);
+	_isClosing = true;
+	pthread_cond_signal(&_cond);
+	pthread_mutex_unlock(&_mutex);
+
+	pthread_join(_writerId, NULL);
+	_file = NULL;
+	free(_buffer);
+	free(_spare);
+	_buffer = _spare = NULL;
+}//void TrafficCapture::Close()
@@ -0,0 +1,69 @@
+/**
+    @file TrafficCapture.h
+    @brief Declaration of the TrafficCapture class which records the requests and responses passing through the XMLIAClient threads
+
+	Capture is enabled by configuring CaptureFile in Conf/session.conf. Each request received from the Request Message Queue and each
+	response pushed to the Response Message Queue is written to the gzip compressed file as a CaptureRecord followed by the payload.
+	Tools/TrafficReplay replays the file against a Session Layer and can act as a stand-in SPS answering with the captured responses.
+
+	The XMLIAClient threads only copy the messages into a memory buffer of CaptureBufferKB, under a lock held for the copy. A writer
+	thread swaps the buffer out and compresses it to the file, so the compression never holds up the XMLIAClient threads. A message
+	which does not fit in a full buffer is dropped and counted in DroppedCaptures instead of waiting for the writer.
+*/
+
+#ifndef _TRAFFIC_CAPTURE_H_
+#define _TRAFFIC_CAPTURE_H_
+
+#include <pthread.h>
+
+#define CAPTURE_FILE_MAGIC 		0x43505053		//!< "SPPC" identifying the capture file
+#define CAPTURE_FILE_VERSION 	1				//!< Version of the file layout
+#define CAPTURE_USER_LENGTH 	32				//!< Length of the user name field
+
+namespace SPS
+{
+	//! Direction of a captured message
+	enum CaptureKind
+	{
+		CAPTURE_REQUEST = 1,		//!< Request read from the Request Message Queue, without the Service Layer header
+		CAPTURE_RESPONSE = 2		//!< Response pushed to the Response Message Queue in the serialized form
+	};
+
+	struct CaptureFileHeader
+	{
+		unsigned int 	magic;			//!< CAPTURE_FILE_MAGIC
+		unsigned int 	version;		//!< CAPTURE_FILE_VERSION
+	};
+
+	struct CaptureRecord
+	{
+		long long 		timestamp;							//!< Time in epoch microseconds at which the message passed
+		long long 		mType;								//!< mType of the message
+		unsigned int 	kind;								//!< CaptureKind
+		unsigned int 	length;								//!< Length of the payload following the record
+		char 			userName[CAPTURE_USER_LENGTH];		//!< User to which the message belongs
+	};
+
+	class TrafficCapture
+	{
+		public:
+			static int Open(const char *pFileName, int pBufferSize);
+			static void Record(CaptureKind pKind, const char *pUserName, long pMType, const char *pPayload);
+			static void Close();
+
+		private:
+			static void* writerThread(void *pArg);
+
+			static pthread_mutex_t 	_mutex;			//!< Protects the buffer
+			static pthread_cond_t 	_cond;			//!< Signalled when the buffer is half full or the capture is closed
+			static pthread_t 		_writerId;		//!< Writer thread
+			static void 			*_file;			//!< gzFile of the capture, NULL when capture is disabled
+			static char 			*_buffer;		//!< Messages copied by the XMLIAClient threads, waiting for the writer
+			static char 			*_spare;		//!< Buffer being written by the writer thread
+			static size_t 			_size;			//!< Size of each of the buffers
+			static size_t 			_used;			//!< Bytes used in _buffer
+			static bool 			_isClosing;		//!< Set by Close to make the writer flush and exit
+	};
+}
+
+#endif
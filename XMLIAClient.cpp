@@ -10,6 +10,20 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <ABL_Exception.h>
+#include <RequestHeader.h>
+#include <SessionConfig.h>
+#include <SessionStats.h>
+#include <AdmissionControl.h>
+#include <RequestCoalescer.h>
+#include <FlightRecorder.h>
+#include <TrafficCapture.h>
+#include <HeartbeatMonitor.h>
+#include <QueueShards.h>
+#include <LeaseManager.h>
+#include <ThreadPlacement.h>
+#include <ShutdownDrain.h>
+#include <errno.h>
+#include <unistd.h>
 
 extern ABL_Logger gABLLoggerObj;    //!< Global ABL Logger Object for logging
 
@@ -42,36 +56,103 @@ int XMLIAClient::sendBytes(char *pMessage)
 }
 
 /**
- * @fn recvResponse
- * @param Nil
- * @ret returns the response received over socket
- * @brief This member function is used to receive the response from SPS
+ * @fn receiveInto
+ * @param Socket descriptor connected to SPS
+ * @param Character buffer to hold the response, owned by the calling thread
+ * @param Length of the buffer
+ * @ret returns the length of the response received
+ * @brief Receives the response from SPS into the buffer of the caller, so that the request path does not allocate any memory. During
+		any failure, the fucntion will throw an error which should be handled in the calling function
  */
-std::string XMLIAClient::recvResponse()
+static int receiveInto(int pSocketDesc, char *pResponse, int pResponseLen)
 {
-	int 	lReturn;			//! Used to hold the return value for recv
-	char 	lResponse[4096];	//!< Character buffer to hold the response from SPS
-	
-	memset(lResponse, '\0', sizeof(lResponse));
+	int 	lReturn;				//! Used to hold the return value for recv
+	char 	lLogMsgBuf[4200];		//!< Logger Message Buffer
+
 	//! Receiving the response from SPS
-	lReturn = recv(_socketDesc, lResponse, 4095, 0);
+	lReturn = recv(pSocketDesc, pResponse, pResponseLen - 1, 0);
 
 	//! If there is any error in receiving the response from SPS, throw an exception
 	if (lReturn <= 0)
 	{
+		pResponse[0] = '\0';
 		throw ABL_Exception(5016, __FILE__, __LINE__, "Unable to receive data on socket. Socket Error");
 	}
+	pResponse[lReturn] = '\0';
+
+	snprintf(lLogMsgBuf, sizeof(lLogMsgBuf), "Response : %s", pResponse);
+	gABLLoggerObj<<INFO<<lLogMsgBuf<<Endl;
+
+	return lReturn;
+}//static int receiveInto(int pSocketDesc, char *pResponse, int pResponseLen)
+
+/**
+ * @fn recvResponse
+ * @param Nil
+ * @ret returns the response received over socket
+ * @brief This member function is used to receive the response from SPS
+ */
+std::string XMLIAClient::recvResponse()
+{
+	char 	lResponse[4096];	//!< Character buffer to hold the response from SPS
 	
-	//! On successful receive, return the message received over socket to the calling fucntion
-	memset(_logMsgBuf, '\0', sizeof(_logMsgBuf));
-	sprintf(_logMsgBuf, "Response : %s", lResponse);
-	gABLLoggerObj<<INFO<<_logMsgBuf<<Endl;
-	
+	receiveInto(_socketDesc, lResponse, sizeof(lResponse));
 	return lResponse;
 }//std::string XMLIAClient::recvResponse()
 
 
 
+/**
+ * @fn renderLogin
+ * @param SPS home path
+ * @param User name
+ * @param Password
+ * @ret returns the login request
+ * @brief The login request is rendered once into a buffer of the calling thread and rendered again only when the SPS server or the
+		user changes, so that a reconnect does not rebuild it.
+ */
+static char* renderLogin(const char *pSPSHomePath, const char *pUserName, const char *pPassword)
+{
+	static __thread char 	lsRequest[4096];		//!< Rendered login request
+	static __thread char 	lsSPSHomePath[1024];	//!< SPS home path of the rendered request
+	static __thread char 	lsUserName[256];		//!< User of the rendered request
+	static __thread char 	lsPassword[256];		//!< Password of the rendered request
+
+	if ('\0' == lsRequest[0] || 0 != strcmp(lsSPSHomePath, pSPSHomePath) || 0 != strcmp(lsUserName, pUserName) || 0 != strcmp(lsPassword, pPassword))
+	{
+		//! Current version supports only plain authentication
+		snprintf(lsRequest, sizeof(lsRequest), "<?xml version=\"1.0\" encoding=\"UTF-8\"?><Login xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" xsi:noNamespaceSchemaLocation=\"%s/Conf/SPS.xsd\"><Username>%s</Username><Password>%s</Password><Created></Created><Nonce></Nonce></Login>",
+			pSPSHomePath, pUserName, pPassword);
+		snprintf(lsSPSHomePath, sizeof(lsSPSHomePath), "%s", pSPSHomePath);
+		snprintf(lsUserName, sizeof(lsUserName), "%s", pUserName);
+		snprintf(lsPassword, sizeof(lsPassword), "%s", pPassword);
+	}
+	return lsRequest;
+}//static char* renderLogin(...)
+
+
+
+/**
+ * @fn renderLogout
+ * @param SPS home path
+ * @ret returns the logout request
+ * @brief The logout request is rendered once into a buffer of the calling thread and rendered again only when the SPS server changes
+ */
+static char* renderLogout(const char *pSPSHomePath)
+{
+	static __thread char 	lsRequest[2048];		//!< Rendered logout request
+	static __thread char 	lsSPSHomePath[1024];	//!< SPS home path of the rendered request
+
+	if ('\0' == lsRequest[0] || 0 != strcmp(lsSPSHomePath, pSPSHomePath))
+	{
+		snprintf(lsRequest, sizeof(lsRequest), "<?xml version=\"1.0\" encoding=\"UTF-8\"?><Logout xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" xsi:noNamespaceSchemaLocation=\"%s/Conf/SPS.xsd\"></Logout>", pSPSHomePath);
+		snprintf(lsSPSHomePath, sizeof(lsSPSHomePath), "%s", pSPSHomePath);
+	}
+	return lsRequest;
+}//static char* renderLogout(const char *pSPSHomePath)
+
+
+
 /**
  * @fn establishSPSConnection
  * @param Nil
@@ -85,7 +166,7 @@ int XMLIAClient::establishSPSConnection()
 	int 	lReturn;				//!< Used to hold the return values for called fucntions
 	struct sockaddr_in lServAdd;	//!< Used to hold the address of the SPS Server
 
-
+	FlightRecorder::Record(FR_CONNECT, 0);
 
 	//! Looping through the SPSServerInfoVector to get the details of the active SPS server
 	for (lIndex = 0; lIndex < spsSerInfoVec.size(); lIndex++)
@@ -99,6 +180,8 @@ int XMLIAClient::establishSPSConnection()
 			gABLLoggerObj<<CRITICAL<<"Unable to Create Socket"<<Endl;
 			return -1;
 		}
+		HeartbeatMonitor::SetKeepAlive(_socketDesc);
+		ShutdownDrain::Track(this, _socketDesc);
 
 		//! Storing the address of the SPS server into lServAdd
 		memset(&lServAdd, 0, sizeof(lServAdd));
@@ -141,26 +224,16 @@ int XMLIAClient::establishSPSConnection()
  */
 int XMLIAClient::login()
 {
-	char 		lLoginRequest[4096];	//!< Character buffer to hold the login request
 	char 		lLoginResp[4096];		//!< Character buffer to hold the response for the login request
-	std::string lRespStr;				//!< Temporary string to hold the response
 	char 		*lpStr;					//!< Character pointer to validate the response
 	int lReturn;
 	
-	//! Creating the login request by substituing the username and password. Current version supports only plain authentication
-//	strcpy(lLoginRequest, "<?xml version=\"1.0\" encoding=\"UTF-8\"?><Login xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" xsi:noNamespaceSchemaLocation=\"/home/sps/06-Provisioning/trunk/SPS_5.1.0.0/trunk/Conf/SPS.xsd\"><Username>");
-	strcpy(lLoginRequest, "<?xml version=\"1.0\" encoding=\"UTF-8\"?><Login xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" xsi:noNamespaceSchemaLocation=\"");
-	strcat(lLoginRequest, _spsHomePath);
-	strcat(lLoginRequest, "/Conf/SPS.xsd\"><Username>");
-	strcat(lLoginRequest, pOssUserInfo->userName);
-	strcat(lLoginRequest, "</Username><Password>");
-	strcat(lLoginRequest, pOssUserInfo->password);
-	strcat(lLoginRequest, "</Password><Created></Created><Nonce></Nonce></Login>");
-
-	//! Sending the login request	
+	FlightRecorder::Record(FR_LOGIN, 0);
+
+	//! Sending the login request, pre rendered with the username and password	
 	try
 	{	
-		lReturn = sendBytes(lLoginRequest);
+		lReturn = sendBytes(renderLogin(_spsHomePath, pOssUserInfo->userName, pOssUserInfo->password));
 	}	
 	catch (ABL_Exception &e)
 	{
@@ -171,20 +244,16 @@ int XMLIAClient::login()
 	//! Receiving the response	
 	try
 	{
-		lRespStr.clear();	
-		lRespStr = recvResponse();
+		receiveInto(_socketDesc, lLoginResp, sizeof(lLoginResp));
 	}	
 	catch (ABL_Exception &e)
 	{
                 gABLLoggerObj<<_ERROR<<"Unable to Receive Login Response"<<Endl;
 		return -1;
 	}
-//	strcpy(lLoginResp, lRespStr.c_str());
-
 	
 	//! Checking for the sub string Login Successful in the received response.If its present, then login is successfull and if not its a login failure
-	//lpStr = strstr(lRespStr.c_str(), "Login Successful");
-	lpStr = const_cast<char*> (strstr(lRespStr.c_str(), "Login Successful"));
+	lpStr = strstr(lLoginResp, "Login Successful");
 	if (NULL == lpStr)
 	{
 		gABLLoggerObj<<_ERROR<<"Login to SPS Failed. Please check username and Password"<<Endl;
@@ -209,20 +278,15 @@ int XMLIAClient::login()
  */
 int XMLIAClient::logout()
 {
-	char 		lLogoutRequest[4096];	//!< Character buffer to hold the logout request
-	std::string lRespStr;				//!< String used to get the response for logout request
+	char 		lLogoutResp[4096];		//!< Character buffer to hold the response for the logout request
 	int 		lReturn;				//!< Used to hold the return value from called function
 
-	//! Preparing the logout command
-	strcpy(lLogoutRequest, "<?xml version=\"1.0\" encoding=\"UTF-8\"?><Logout xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" xsi:noNamespaceSchemaLocation=\"");
-
-strcat(lLogoutRequest, _spsHomePath);
-    strcat(lLogoutRequest, "/Conf/SPS.xsd\"></Logout>");
+	FlightRecorder::Record(FR_LOGOUT, 0);
 
 	//! Sending the logout command. On any error, fucntion returns -1
 	try
     {
-        lReturn = sendBytes(lLogoutRequest);
+        lReturn = sendBytes(renderLogout(_spsHomePath));
     }
     catch (ABL_Exception &e)
     {
@@ -233,8 +297,7 @@ strcat(lLogoutRequest, _spsHomePath);
 	//! Receiving the response for logout. If any error occurs, function returns -1
     try
     {
-		lRespStr.clear();
-        lRespStr = recvResponse();
+        receiveInto(_socketDesc, lLogoutResp, sizeof(lLogoutResp));
     }
     catch (ABL_Exception &e)
     {
@@ -246,6 +309,79 @@ strcat(lLogoutRequest, _spsHomePath);
 
 
 
+/**
+ * @fn getPeerName
+ * @param Socket descriptor connected to SPS
+ * @param Character buffer to hold the name
+ * @param Length of the buffer
+ * @ret returns the address and port of the SPS server packed into an integer, 0 if the socket is not connected
+ * @brief Gets the <ip>:<port> of the SPS server to which the socket is connected. Used to apply the admission limits per SPS server
+ */
+static unsigned long long getPeerName(int pSocketDesc, char *pName, int pNameLen)
+{
+	struct sockaddr_in 	lPeerAdd;						//!< Address of the SPS server
+	socklen_t 			lAddLen = sizeof(lPeerAdd);		//!< Length of the address
+
+	memset(pName, '\0', pNameLen);
+	if (0 != getpeername(pSocketDesc, (struct sockaddr*) &lPeerAdd, &lAddLen))
+	{
+		strncpy(pName, "unknown", pNameLen - 1);
+		return 0;
+	}
+	snprintf(pName, pNameLen, "%s:%d", inet_ntoa(lPeerAdd.sin_addr), ntohs(lPeerAdd.sin_port));
+	return ((unsigned long long) ntohl(lPeerAdd.sin_addr.s_addr) << 16) | ntohs(lPeerAdd.sin_port);
+}//static unsigned long long getPeerName(int pSocketDesc, char *pName, int pNameLen)
+
+
+
+/**
+ * @fn isSocketAlive
+ * @param Socket descriptor connected to SPS
+ * @ret returns false if SPS has closed the connection or the socket is in error
+ * @brief Peeks the socket without blocking. Used on idle connections, where no data is expected from SPS
+ */
+static bool isSocketAlive(int pSocketDesc)
+{
+	char 	lByte;		//!< Byte peeked from the socket
+	int 	lReturn;	//!< Used to hold the return value of recv
+
+	lReturn = recv(pSocketDesc, &lByte, 1, MSG_PEEK | MSG_DONTWAIT);
+	if (0 == lReturn)
+	{
+		return false;
+	}
+	if (lReturn < 0 && EAGAIN != errno && EWOULDBLOCK != errno)
+	{
+		return false;
+	}
+	return true;
+}//static bool isSocketAlive(int pSocketDesc)
+
+
+
+/**
+ * @fn pushToWaiters
+ * @param Pointer to the user to which the request belongs
+ * @param Request sent to SPS
+ * @param Response pushed for the request
+ * @ret void
+ * @brief Pushes the response once for each of the identical requests which were coalesced with the request sent to SPS
+ */
+static void pushToWaiters(OSSUserInfo *pUser, const char *pRequest, MsqQueStruct &pResp)
+{
+	std::vector<long> 	lWaiters;	//!< mTypes of the coalesced requests
+	int 				lIndex;		//!< Used as index in loops
+
+	RequestCoalescer::Finish(pUser->userName, pRequest, lWaiters);
+	for (lIndex = 0; lIndex < lWaiters.size(); lIndex++)
+	{
+		pResp.mType = lWaiters[lIndex];
+		AdmissionControl::PushResponse(pUser, pResp);
+	}
+}//static void pushToWaiters(OSSUserInfo *pUser, const char *pRequest, MsqQueStruct &pResp)
+
+
+
 /**
  * @fn startProcess
  * @param Nil
@@ -256,10 +392,28 @@ void XMLIAClient::startProcess()
 {
 	int 		lReturn;				//!< Used to hold the return value in funtion calls
 	int 		lResponseLen;			//!< Used to hold the response length	
-	std::string lResp;					//!< Response will be stored to this variable
-//	char 		lResponse[4096];
-	MsqQueStruct lReqMsgQueStructObj;	//!< Structure to store the request from the Request Message Queue
+	char 		lResp[4096];			//!< Response will be stored to this buffer, reused for every request of the connection
+	MsqQueStruct lReqMsgQueStructObj;	//!< Structure to which the request is read from the Request Message Queue
 	MsqQueStruct lRespMsgQueStructObj;	//!< Structure to hold the response which has to be pushed to the Response Message Queue
+	RequestHeader lReqHeader;			//!< Control information sent by the Service Layer along with the request
+	int 		lMaxQueueAge;			//!< Maximum time in milliseconds a request may wait in the Request Message Queue
+	char 		lServerName[64];		//!< <ip>:<port> of the SPS server serving the request
+	int 		lPeerSocket = -1;		//!< Socket for which lServerName and lServerKey were looked up, reset on every reconnect
+	unsigned long long 	lServerKey = 0;	//!< Address of the SPS server packed into an integer
+	const char 	*lpShedReason;			//!< Name of the admission limit which tripped
+	long long 	lSentTime;				//!< Time in epoch milliseconds at which the request was sent to SPS
+	bool 		lIsCoalesced;			//!< Set when identical requests may be waiting on the response of this request
+	bool 		lIsAlive;				//!< Result of the heartbeat check on the connection
+	char 		lHeartbeatRequest[1024];	//!< Request sent to SPS on a heartbeat, empty to only check the socket
+	int 		lShard;					//!< Request Message Queue shard of the user to which this thread is tied
+	volatile long long 	*lpActivity;	//!< Time of the last activity of the connection, read by the HeartbeatMonitor
+
+	lMaxQueueAge = SessionConfig::GetInt("RequestMaxQueueAgeMs", 0);
+	memset(lHeartbeatRequest, '\0', sizeof(lHeartbeatRequest));
+	strncpy(lHeartbeatRequest, SessionConfig::GetString("HeartbeatRequest", ""), sizeof(lHeartbeatRequest) - 1);
+
+	lShard = QueueShards::Attach(pOssUserInfo, this);
+	lpActivity = HeartbeatMonitor::Attach(this);
 
 	//!< Releasing the move forward Semaphore so that the Start can return to the calling function
 	moveForwardSem.mb_release();		
@@ -275,19 +429,53 @@ void XMLIAClient::startProcess()
 	{
 		std::cout << "Starting to Read from Queue " << std::endl;
 		
-		//! Reading the message into the MsqQueStruct object
-		memset(lReqMsgQueStructObj.xmlRequest, '\0', 4096);
-		lReqMsgQueStructObj = pOssUserInfo->GetMessage();
+		//! When several instances run, the shard this thread is tied to may have moved to another instance. The thread then moves to
+		//! a shard this instance holds, and waits while it holds none
+		if (lShard < 0 || !LeaseManager::IsOwned(pOssUserInfo, lShard))
+		{
+			QueueShards::Detach(pOssUserInfo, this);
+			lShard = QueueShards::Attach(pOssUserInfo, this);
+			if (lShard < 0)
+			{
+				if (_isStopSignalReceived)
+				{
+					break;
+				}
+				sleep(1);
+				continue;
+			}
+		}
+
+		FlightRecorder::Record(FR_QUEUE_WAIT, 0);
+		HeartbeatMonitor::Touch(lpActivity);
+		//! Reading the message straight into the MsqQueStruct object of the thread, which is reused for every request
+		QueueShards::GetMessage(pOssUserInfo, lShard, lReqMsgQueStructObj);
+		FlightRecorder::Record(FR_DISPATCH, lReqMsgQueStructObj.mType);
 
 		memset(_logMsgBuf, '\0', sizeof(_logMsgBuf));
         	sprintf(_logMsgBuf, "Request Received : %s", lReqMsgQueStructObj.xmlRequest);
         	gABLLoggerObj<<INFO<<_logMsgBuf<<Endl;
 		
-		//!< If the message received is a stop signal
-		if (!strcmp(lReqMsgQueStructObj.xmlRequest, "STOP"))
+		//!< If the message received is a stop signal. A stop message is read by a thread of another user object only when it was
+		//!< blocked on the queue, as the own stop message is taken first. A stop message which still has a reader is put back,
+		//!< blocking rather than losing it, and one left by a removed user object or a gone instance is dropped
+		if (STOP_MTYPE_BASE <= lReqMsgQueStructObj.mType)
 		{
-                	gABLLoggerObj<<INFO<<"Stop Signal Received From Parent"<<Endl;
-			break;
+			if (QueueShards::GetStopMType(pOssUserInfo) == lReqMsgQueStructObj.mType)
+			{
+                		gABLLoggerObj<<INFO<<"Stop Signal Received From Parent"<<Endl;
+				break;
+			}
+			if (QueueShards::IsStopMType(lReqMsgQueStructObj.mType))
+			{
+				msgsnd(QueueShards::GetRequestQueueId(pOssUserInfo, lShard), &lReqMsgQueStructObj, sizeof(lReqMsgQueStructObj.xmlRequest), 0);
+				usleep(STOP_REQUEUE_WAIT * 1000);
+				continue;
+			}
+			memset(_logMsgBuf, '\0', sizeof(_logMsgBuf));
+			sprintf(_logMsgBuf, "Stale Stop Message Dropped for User : %s | mType : %ld", pOssUserInfo->userName, lReqMsgQueStructObj.mType);
+			gABLLoggerObj<<INFO<<_logMsgBuf<<Endl;
+			continue;
 		}
 		
 		//! Checking if the message is an error message due to any failure in retreiving the request from the queue.
@@ -297,13 +485,141 @@ void XMLIAClient::startProcess()
 			break;
 		}
 
+		//! PING messages are pushed by the HeartbeatMonitor when the connection was idle. The connection is checked and if SPS does not
+		//! respond, it is replaced now instead of on the next request of the Service Layer
+		if (HEARTBEAT_MTYPE == lReqMsgQueStructObj.mType && !strcmp(lReqMsgQueStructObj.xmlRequest, "PING"))
+		{
+			HeartbeatMonitor::Consumed(pOssUserInfo);
+
+			lIsAlive = isSocketAlive(_socketDesc);
+			if (lIsAlive && '\0' != lHeartbeatRequest[0])
+			{
+				try
+				{
+					sendBytes(lHeartbeatRequest);
+					receiveInto(_socketDesc, lResp, sizeof(lResp));
+				}
+				catch (ABL_Exception &e)
+				{
+					lIsAlive = false;
+				}
+			}
+			if (lIsAlive)
+			{
+				continue;
+			}
+
+			memset(_logMsgBuf, '\0', sizeof(_logMsgBuf));
+			sprintf(_logMsgBuf, "Heartbeat Failed for User : %s | Dead Connections : %ld | Reconnecting", pOssUserInfo->userName, SessionStats::Increment(DEAD_CONNECTIONS));
+			gABLLoggerObj<<_ERROR<<_logMsgBuf<<Endl;
+
+			close(_socketDesc);
+			isConnected = false;
+			lPeerSocket = -1;
+			if (0 != establishSPSConnection())
+			{
+				gABLLoggerObj<<_ERROR<<"Unable to Replace the Dead Connection"<<Endl;
+				//! Freeing the shard first, so that the replacement started by DecrementConnectionCount is tied to it
+				QueueShards::Detach(pOssUserInfo, this);
+				pOssUserInfo->DecrementConnectionCount();
+				break;
+			}
+			isConnected = true;
+			gABLLoggerObj<<INFO<<"Dead Connection Replaced"<<Endl;
+			continue;
+		}
+
+		//! While the user is being stopped no request is sent to SPS, the caller gets the retriable response at once
+		if (ShutdownDrain::IsDraining(pOssUserInfo))
+		{
+			ShutdownDrain::Reject(pOssUserInfo, lReqMsgQueStructObj.mType, lRespMsgQueStructObj, true);
+			continue;
+		}
+
+		//! Removing the header added by the Service Layer. If the caller has already timed out, the request is not sent to SPS and a
+		//! timeout response is pushed immediately so that an overloaded SPS does not spend time on requests nobody is waiting for.
+		//! A header without its closing bracket cannot be removed, so the request is answered with the error response.
+		if (-1 == lReqHeader.Parse(lReqMsgQueStructObj.xmlRequest))
+		{
+			memset(_logMsgBuf, '\0', sizeof(_logMsgBuf));
+			sprintf(_logMsgBuf, "Malformed Request Header for User : %s | mType : %ld", pOssUserInfo->userName, lReqMsgQueStructObj.mType);
+			gABLLoggerObj<<_ERROR<<_logMsgBuf<<Endl;
+
+			memset(lRespMsgQueStructObj.xmlRequest, '\0', 4096);
+			strcpy(lRespMsgQueStructObj.xmlRequest, "s:17:\"SessionLayerError\";");
+			lRespMsgQueStructObj.mType = lReqMsgQueStructObj.mType;
+			AdmissionControl::PushResponse(pOssUserInfo, lRespMsgQueStructObj);
+			continue;
+		}
+		TrafficCapture::Record(CAPTURE_REQUEST, pOssUserInfo->userName, lReqMsgQueStructObj.mType, lReqMsgQueStructObj.xmlRequest);
+		if (lReqHeader.IsExpired(RequestHeader::NowMillis(), lMaxQueueAge))
+		{
+			memset(lRespMsgQueStructObj.xmlRequest, '\0', 4096);
+			strcpy(lRespMsgQueStructObj.xmlRequest, "s:19:\"SessionLayerTimeout\";");
+			lRespMsgQueStructObj.mType = lReqMsgQueStructObj.mType;
+			AdmissionControl::PushResponse(pOssUserInfo, lRespMsgQueStructObj);
+
+			memset(_logMsgBuf, '\0', sizeof(_logMsgBuf));
+			sprintf(_logMsgBuf, "Request Expired in Queue for User : %s | mType : %ld | Expired Requests : %ld", pOssUserInfo->userName, lReqMsgQueStructObj.mType, SessionStats::Increment(EXPIRED_REQUESTS));
+			gABLLoggerObj<<INFO<<_logMsgBuf<<Endl;
+			continue;
+		}
+
+		//! If an identical read only request is already in flight, this request waits on its response and is not sent to SPS
+		lIsCoalesced = RequestCoalescer::IsCoalescable(lReqMsgQueStructObj.xmlRequest);
+		if (lIsCoalesced && RequestCoalescer::Join(pOssUserInfo->userName, lReqMsgQueStructObj.xmlRequest, lReqMsgQueStructObj.mType))
+		{
+			memset(_logMsgBuf, '\0', sizeof(_logMsgBuf));
+			sprintf(_logMsgBuf, "Request Coalesced for User : %s | mType : %ld", pOssUserInfo->userName, lReqMsgQueStructObj.mType);
+			gABLLoggerObj<<INFO<<_logMsgBuf<<Endl;
+			continue;
+		}
+
+		//! Applying the admission limits. When SPS is overloaded, the request is answered immediately with the error response instead of
+		//! letting the latency build up for all the callers.
+		if (lPeerSocket != _socketDesc)
+		{
+			lServerKey = getPeerName(_socketDesc, lServerName, sizeof(lServerName));
+			lPeerSocket = _socketDesc;
+		}
+		lpShedReason = AdmissionControl::Admit(pOssUserInfo, lServerKey);
+		if (NULL != lpShedReason)
+		{
+			memset(lRespMsgQueStructObj.xmlRequest, '\0', 4096);
+			strcpy(lRespMsgQueStructObj.xmlRequest, "s:17:\"SessionLayerError\";");
+			lRespMsgQueStructObj.mType = lReqMsgQueStructObj.mType;
+			AdmissionControl::PushResponse(pOssUserInfo, lRespMsgQueStructObj);
+			if (lIsCoalesced)
+			{
+				pushToWaiters(pOssUserInfo, lReqMsgQueStructObj.xmlRequest, lRespMsgQueStructObj);
+			}
+
+			memset(_logMsgBuf, '\0', sizeof(_logMsgBuf));
+			sprintf(_logMsgBuf, "Request Shed for User : %s | Server : %s | mType : %ld | Limit : %s", pOssUserInfo->userName, lServerName, lReqMsgQueStructObj.mType, lpShedReason);
+			gABLLoggerObj<<INFO<<_logMsgBuf<<Endl;
+			continue;
+		}
+		lSentTime = RequestHeader::NowMillis();
+
 		//! Sending the Message to SPS over TCP.
 		try
 		{
+			FlightRecorder::Record(FR_SEND, lReqMsgQueStructObj.mType);
 			lReturn = sendBytes(lReqMsgQueStructObj.xmlRequest);
 		}
 		catch (ABL_Exception &e)
 		{
+			//! While the user is being stopped the connection is not replaced, the request fails with the retriable response
+			if (ShutdownDrain::IsDraining(pOssUserInfo))
+			{
+				ShutdownDrain::Reject(pOssUserInfo, lReqMsgQueStructObj.mType, lRespMsgQueStructObj, true);
+				if (lIsCoalesced)
+				{
+					pushToWaiters(pOssUserInfo, lReqMsgQueStructObj.xmlRequest, lRespMsgQueStructObj);
+				}
+				AdmissionControl::Complete(pOssUserInfo, lServerKey, RequestHeader::NowMillis() - lSentTime);
+				break;
+			}
 
 
 			// Added to try establishing connection to SPS infinitely
@@ -312,6 +628,7 @@ void XMLIAClient::startProcess()
 			
 
 			isConnected = false;
+			lPeerSocket = -1;
 			lReturn = establishSPSConnection();
 			if ( 0 == lReturn )
 			{
@@ -327,9 +644,16 @@ void XMLIAClient::startProcess()
                 		sprintf(_logMsgBuf, "Response Sent : %s", lRespMsgQueStructObj.xmlRequest);
                 		gABLLoggerObj<<INFO<<_logMsgBuf<<Endl;
 	        		lRespMsgQueStructObj.mType = lReqMsgQueStructObj.mType;
-    	    			pOssUserInfo->PushMessage(lRespMsgQueStructObj);
+    	    			AdmissionControl::PushResponse(pOssUserInfo, lRespMsgQueStructObj);
+				if (lIsCoalesced)
+				{
+					pushToWaiters(pOssUserInfo, lReqMsgQueStructObj.xmlRequest, lRespMsgQueStructObj);
+				}
+
+				AdmissionControl::Complete(pOssUserInfo, lServerKey, RequestHeader::NowMillis() - lSentTime);
 
 				//! Decrementing the connection count and exiting	
+				QueueShards::Detach(pOssUserInfo, this);
 				pOssUserInfo->DecrementConnectionCount();
 				
 				break;
@@ -349,15 +673,27 @@ void XMLIAClient::startProcess()
 		//! Receiving the response from the SPS.
 		try
 		{
-			lResp.clear();
-			lResp = recvResponse();
+			FlightRecorder::Record(FR_RECV, lReqMsgQueStructObj.mType);
+			receiveInto(_socketDesc, lResp, sizeof(lResp));
 		}
 		catch (ABL_Exception &e)
 		{
+			//! While the user is being stopped the connection is not replaced, the request fails with the retriable response
+			if (ShutdownDrain::IsDraining(pOssUserInfo))
+			{
+				ShutdownDrain::Reject(pOssUserInfo, lReqMsgQueStructObj.mType, lRespMsgQueStructObj, true);
+				if (lIsCoalesced)
+				{
+					pushToWaiters(pOssUserInfo, lReqMsgQueStructObj.xmlRequest, lRespMsgQueStructObj);
+				}
+				AdmissionControl::Complete(pOssUserInfo, lServerKey, RequestHeader::NowMillis() - lSentTime);
+				break;
+			}
             		close(_socketDesc);
 
 
             		isConnected = false;
+			lPeerSocket = -1;
                 	lReturn = establishSPSConnection();
                 	if ( 0 == lReturn )
                 	{
@@ -368,13 +704,20 @@ void XMLIAClient::startProcess()
 				memset(lRespMsgQueStructObj.xmlRequest, 0, 4096);
                         	strcpy(lRespMsgQueStructObj.xmlRequest, "s:17:\"SessionLayerError\";");
                         	lRespMsgQueStructObj.mType = lReqMsgQueStructObj.mType;
-                        	pOssUserInfo->PushMessage(lRespMsgQueStructObj);
+                        	AdmissionControl::PushResponse(pOssUserInfo, lRespMsgQueStructObj);
+				if (lIsCoalesced)
+				{
+					pushToWaiters(pOssUserInfo, lReqMsgQueStructObj.xmlRequest, lRespMsgQueStructObj);
+				}
 
                         	memset(_logMsgBuf, '\0', sizeof(_logMsgBuf));
                         	sprintf(_logMsgBuf, "Response Sent : %s", lRespMsgQueStructObj.xmlRequest);
                         	gABLLoggerObj<<INFO<<_logMsgBuf<<Endl;
 				
+				AdmissionControl::Complete(pOssUserInfo, lServerKey, RequestHeader::NowMillis() - lSentTime);
+
 				//! Decrementing the connection count and exiting	
+				QueueShards::Detach(pOssUserInfo, this);
 				pOssUserInfo->DecrementConnectionCount();
 
 				break;
@@ -382,8 +725,7 @@ void XMLIAClient::startProcess()
 			if (isConnected == true)
                         {
                                 lReturn = sendBytes(lReqMsgQueStructObj.xmlRequest);
-				lResp.clear();
-                        	lResp = recvResponse();				
+				receiveInto(_socketDesc, lResp, sizeof(lResp));
                         }
 			else
 			{
@@ -392,25 +734,50 @@ void XMLIAClient::startProcess()
 
         	}
 
-		lResponseLen = strlen(lResp.c_str());
-		//sprintf(lRespMsgQueStructObj.xmlRequest,"s:%d:\"%s\";", lResponseLen, lResponse);	
+		AdmissionControl::Complete(pOssUserInfo, lServerKey, RequestHeader::NowMillis() - lSentTime);
+
 
 		//! If the response received is SUCCESS, then the message to be pushed into the queue should be in the format s:7:"SUCCESS".
 		//! This is because, the Service Layer written in PHP has got a different serialization protocol. The ideal message format is s:<msg len>:"<message>"
+		//! A response which does not fit in the message with its header is failed, as a truncated one would not match its length
 		memset(lRespMsgQueStructObj.xmlRequest, '\0', 4096);
-		sprintf(lRespMsgQueStructObj.xmlRequest,"s:%d:\"%s\";", lResponseLen, lResp.c_str());	
+		lResponseLen = strlen(lResp);
+		if (snprintf(lRespMsgQueStructObj.xmlRequest, sizeof(lRespMsgQueStructObj.xmlRequest), "s:%d:\"%s\";", lResponseLen, lResp) >= (int) sizeof(lRespMsgQueStructObj.xmlRequest))
+		{
+			memset(_logMsgBuf, '\0', sizeof(_logMsgBuf));
+			sprintf(_logMsgBuf, "Response Too Long for the Response Message Queue for User : %s | mType : %ld | Length : %d", pOssUserInfo->userName, lReqMsgQueStructObj.mType, lResponseLen);
+			gABLLoggerObj<<_ERROR<<_logMsgBuf<<Endl;
+			memset(lRespMsgQueStructObj.xmlRequest, '\0', 4096);
+			strcpy(lRespMsgQueStructObj.xmlRequest, "s:17:\"SessionLayerError\";");
+		}
 		lRespMsgQueStructObj.mType = lReqMsgQueStructObj.mType;
 
-		//!< Pushing the message to the response queue
-		pOssUserInfo->PushMessage(lRespMsgQueStructObj);
+		//!< Pushing the message to the response queue without blocking on a full queue
+		FlightRecorder::Record(FR_PUSH, lReqMsgQueStructObj.mType);
+		AdmissionControl::PushResponse(pOssUserInfo, lRespMsgQueStructObj);
+		if (lIsCoalesced)
+		{
+			pushToWaiters(pOssUserInfo, lReqMsgQueStructObj.xmlRequest, lRespMsgQueStructObj);
+		}
 
+		//! The connection was in use till now, so it is not counted as idle for a request which took longer than the interval
+		HeartbeatMonitor::Touch(lpActivity);
 	}
 
-	//! In case of failure or system shut down, logout from SPS and close the socket
+	//! In case of failure or system shut down, logout from SPS and close the socket. While the user is being stopped the logout may
+	//! wait on SPS only for ShutdownLogoutTimeoutMs
+	if (ShutdownDrain::IsDraining(pOssUserInfo))
+	{
+		ShutdownDrain::BoundLogout(_socketDesc);
+	}
 	logout();
+	ShutdownDrain::Remove(this);
 	close(_socketDesc);
 	std::cout << "############# XMLIA CLient Thread Exiting ###############" << threadID <<std::endl;
 	isConnected = false;
+	HeartbeatMonitor::Remove(this);
+	QueueShards::Detach(pOssUserInfo, this);
+	FlightRecorder::Record(FR_EXIT, 0);
 	pthread_exit(NULL);
 }//void XMLIAClient::startProcess()
 
@@ -424,7 +791,10 @@ void XMLIAClient::startProcess()
  */
 int XMLIAClient::Start()
 {
-	int 	lReturn;		//!< Used to hold the return values from called function
+	int 			lReturn;		//!< Used to hold the return values from called function
+	pthread_attr_t 	lThreadAttr;	//!< Attributes of the thread, used when a placement is configured for the user
+	cpu_set_t 		lSavedCpus;		//!< CPUs of the calling thread while the thread is created
+	bool 			lIsPlaced;		//!< Set when a placement is configured for the user
 
 	
 	//! Establishing connection to SPS
@@ -433,17 +803,26 @@ int XMLIAClient::Start()
 	if (-1 == lReturn)
 	{
                 gABLLoggerObj<<_ERROR<<"Unable to Establish Connection with SPS Return from XMLIAClient::Start()"<<Endl;
+		ShutdownDrain::Remove(this);
 		return -1;
 	}
 	
 	// Incrementing the connection count
 	pOssUserInfo->IncrementConnectionCount();
 	
+	//! Starting the monitor which checks the idle connections, only the first call starts it
+	HeartbeatMonitor::Start();
+
 	//! Acquiring the moveforward semaphore. This semaphore will be released once startProcess thread is started
 	moveForwardSem.mb_acquire();
 
-	//! Creating a thread to serve the request for the user
-	ExecuteInNewThread0(&threadID, NULL, XMLIAClient, this, void, &XMLIAClient::startProcess);
+	//! Creating a thread to serve the request for the user, on the CPUs and with the stack size configured for the user
+	lIsPlaced = ThreadPlacement::Prepare(pOssUserInfo, &lThreadAttr, &lSavedCpus);
+	ExecuteInNewThread0(&threadID, lIsPlaced ? &lThreadAttr : NULL, XMLIAClient, this, void, &XMLIAClient::startProcess);
+	if (lIsPlaced)
+	{
+		ThreadPlacement::Restore(&lThreadAttr, &lSavedCpus);
+	}
 	
 	//! Storing the object pointer to the XMLIAClientVector
 	XMLIAClient::xmliaClientVec.push_back(this);